@@ -0,0 +1,11 @@
+.junk/12term/bench/bench.c.mk .junk/12term/src/bench/bench.c.o: \
+ src/bench/bench.c src/bench/../common.h src/bench/../debug.h \
+ src/bench/../buffer.h src/bench/../buffer2.h src/bench/../ctlseqs.h \
+ src/bench/../utf8.h src/bench/../unicode.h
+src/bench/../common.h:
+src/bench/../debug.h:
+src/bench/../buffer.h:
+src/bench/../buffer2.h:
+src/bench/../ctlseqs.h:
+src/bench/../utf8.h:
+src/bench/../unicode.h:
@@ -0,0 +1,11 @@
+.junk/12term/buffer.c.mk .junk/12term/src/buffer.c.o: src/buffer.c \
+ src/common.h src/debug.h src/buffer.h src/ctlseqs.h src/settings.h \
+ src/host.h src/history.h src/unicode.h
+src/common.h:
+src/debug.h:
+src/buffer.h:
+src/ctlseqs.h:
+src/settings.h:
+src/host.h:
+src/history.h:
+src/unicode.h:
@@ -0,0 +1,9 @@
+.junk/12term/clipboard.c.mk .junk/12term/src/clipboard.c.o: \
+ src/clipboard.c src/common.h src/debug.h src/x.h src/buffer.h \
+ src/clipboard.h src/tty.h
+src/common.h:
+src/debug.h:
+src/x.h:
+src/buffer.h:
+src/clipboard.h:
+src/tty.h:
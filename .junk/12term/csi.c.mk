@@ -0,0 +1,11 @@
+.junk/12term/csi.c.mk .junk/12term/src/csi.c.o: src/csi.c src/common.h \
+ src/debug.h src/ctlseqs2.h src/utf8.h src/host.h src/buffer.h \
+ src/buffer2.h src/history.h
+src/common.h:
+src/debug.h:
+src/ctlseqs2.h:
+src/utf8.h:
+src/host.h:
+src/buffer.h:
+src/buffer2.h:
+src/history.h:
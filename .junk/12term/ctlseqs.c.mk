@@ -0,0 +1,12 @@
+.junk/12term/ctlseqs.c.mk .junk/12term/src/ctlseqs.c.o: src/ctlseqs.c \
+ src/common.h src/debug.h src/ctlseqs.h src/ctlseqs2.h src/utf8.h \
+ src/buffer.h src/buffer2.h src/settings.h src/host.h
+src/common.h:
+src/debug.h:
+src/ctlseqs.h:
+src/ctlseqs2.h:
+src/utf8.h:
+src/buffer.h:
+src/buffer2.h:
+src/settings.h:
+src/host.h:
@@ -0,0 +1,6 @@
+.junk/12term/defaults.c.mk .junk/12term/src/defaults.c.o: src/defaults.c \
+ src/common.h src/debug.h src/settings.h src/buffer.h
+src/common.h:
+src/debug.h:
+src/settings.h:
+src/buffer.h:
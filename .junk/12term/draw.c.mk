@@ -0,0 +1,11 @@
+.junk/12term/draw.c.mk .junk/12term/src/draw.c.o: src/draw.c \
+ src/xft/Xft.h src/xft/../common.h src/xft/../debug.h src/x.h \
+ src/buffer.h src/draw.h src/draw2.h src/event.h
+src/xft/Xft.h:
+src/xft/../common.h:
+src/xft/../debug.h:
+src/x.h:
+src/buffer.h:
+src/draw.h:
+src/draw2.h:
+src/event.h:
@@ -0,0 +1,15 @@
+.junk/12term/event.c.mk .junk/12term/src/event.c.o: src/event.c \
+ /tmp/fakeinc/X11/Xcursor/Xcursor.h src/common.h src/debug.h src/event.h \
+ src/x.h src/buffer.h src/keymap.h src/tty.h src/draw.h src/settings.h \
+ src/clipboard.h
+/tmp/fakeinc/X11/Xcursor/Xcursor.h:
+src/common.h:
+src/debug.h:
+src/event.h:
+src/x.h:
+src/buffer.h:
+src/keymap.h:
+src/tty.h:
+src/draw.h:
+src/settings.h:
+src/clipboard.h:
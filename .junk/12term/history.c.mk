@@ -0,0 +1,7 @@
+.junk/12term/history.c.mk .junk/12term/src/history.c.o: src/history.c \
+ src/common.h src/debug.h src/buffer.h src/history.h src/settings.h
+src/common.h:
+src/debug.h:
+src/buffer.h:
+src/history.h:
+src/settings.h:
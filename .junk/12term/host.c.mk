@@ -0,0 +1,6 @@
+.junk/12term/host.c.mk .junk/12term/src/host.c.o: src/host.c src/common.h \
+ src/debug.h src/host.h src/buffer.h
+src/common.h:
+src/debug.h:
+src/host.h:
+src/buffer.h:
@@ -0,0 +1,6 @@
+.junk/12term/icon.c.mk .junk/12term/src/icon.c.o: src/icon.c src/common.h \
+ src/debug.h src/icon.h src/incbin.h
+src/common.h:
+src/debug.h:
+src/icon.h:
+src/incbin.h:
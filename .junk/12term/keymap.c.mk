@@ -0,0 +1,6 @@
+.junk/12term/keymap.c.mk .junk/12term/src/keymap.c.o: src/keymap.c \
+ src/keymap.h src/common.h src/debug.h src/event.h
+src/keymap.h:
+src/common.h:
+src/debug.h:
+src/event.h:
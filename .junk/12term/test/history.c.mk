@@ -0,0 +1,10 @@
+.junk/12term/test/history.c.mk .junk/12term/src/test/history.c.o: \
+ src/test/history.c src/test/../common.h src/test/../debug.h \
+ src/test/../buffer.h src/test/../ctlseqs.h src/test/../history.h \
+ src/test/../settings.h
+src/test/../common.h:
+src/test/../debug.h:
+src/test/../buffer.h:
+src/test/../ctlseqs.h:
+src/test/../history.h:
+src/test/../settings.h:
@@ -0,0 +1,8 @@
+.junk/12term/tty.c.mk .junk/12term/src/tty.c.o: src/tty.c src/common.h \
+ src/debug.h src/tty.h src/ctlseqs.h src/settings.h src/buffer.h
+src/common.h:
+src/debug.h:
+src/tty.h:
+src/ctlseqs.h:
+src/settings.h:
+src/buffer.h:
@@ -0,0 +1,6 @@
+.junk/12term/unicode.c.mk .junk/12term/src/unicode.c.o: src/unicode.c \
+ src/common.h src/debug.h src/unicode.h src/unicode_tables.h
+src/common.h:
+src/debug.h:
+src/unicode.h:
+src/unicode_tables.h:
@@ -0,0 +1,5 @@
+.junk/12term/utf8.c.mk .junk/12term/src/utf8.c.o: src/utf8.c src/common.h \
+ src/debug.h src/utf8.h
+src/common.h:
+src/debug.h:
+src/utf8.h:
@@ -0,0 +1,17 @@
+.junk/12term/x.c.mk .junk/12term/src/x.c.o: src/x.c src/common.h \
+ src/debug.h src/tty.h src/draw.h src/buffer.h src/x.h src/event.h \
+ src/settings.h src/icon.h src/host.h src/draw2.h src/clipboard.h \
+ src/xft/Xft.h
+src/common.h:
+src/debug.h:
+src/tty.h:
+src/draw.h:
+src/buffer.h:
+src/x.h:
+src/event.h:
+src/settings.h:
+src/icon.h:
+src/host.h:
+src/draw2.h:
+src/clipboard.h:
+src/xft/Xft.h:
@@ -0,0 +1,9 @@
+.junk/12term/xft/render.c.mk .junk/12term/src/xft/render.c.o: \
+ src/xft/render.c src/xft/xftint.h src/xft/Xft.h src/xft/../common.h \
+ src/xft/../debug.h src/xft/../x.h src/xft/../buffer.h
+src/xft/xftint.h:
+src/xft/Xft.h:
+src/xft/../common.h:
+src/xft/../debug.h:
+src/xft/../x.h:
+src/xft/../buffer.h:
@@ -0,0 +1,142 @@
+// Benchmark: replay recorded terminal output through the parser and screen buffer, without X
+// usage: 12term-bench <files...>
+// the results are printed as JSON
+// it also compares looking up char widths with the tables in unicode.c against wcwidth(), using the non-ascii chars from the files
+// the files in bench/ were recorded from a pty (80x24, TERM=xterm-256color):
+// - ascii: `cat` of some source files
+// - colorlog: `diff`, `ls`, `grep`, and gcc warnings, with color
+// - cjk_emoji: `cat` of chinese/japanese/korean text, emoji, and combining chars
+// - vim: paging and searching through a file in vim (with syntax highlighting)
+// - top: `top -d 0.1` redrawing
+// - scroll: scrolling line by line in vim (^E/^Y), which uses scroll regions
+// - combining: (generated, not recorded) text with long sequences of combining chars, emoji zwj sequences, and zalgo text
+
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <locale.h>
+#include <string.h>
+#include <time.h>
+
+#include "../common.h"
+#include "../buffer.h"
+#include "../buffer2.h"
+#include "../ctlseqs.h"
+#include "../utf8.h"
+#include "../unicode.h"
+
+// all the recordings are 80x24
+#define WIDTH 80
+#define HEIGHT 24
+// run each file repeatedly until at least this much time has passed
+#define MIN_TIME 0.5
+#define MIN_PASSES 3
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+static utf8* read_file(const utf8* path, long* length) {
+	FILE* f = fopen(path, "rb");
+	if (!f)
+		die("couldn't open %s\n", path);
+	fseek(f, 0, SEEK_END);
+	*length = ftell(f);
+	rewind(f);
+	utf8* data;
+	ALLOC(data, *length);
+	if (fread(data, 1, *length, f) != *length)
+		die("couldn't read %s\n", path);
+	fclose(f);
+	return data;
+}
+
+static void replay(long length, const utf8 data[length]) {
+	full_reset();
+	// feed it in chunks, like tty_read does
+	for (long i=0; i<length; i+=4096)
+		process_chars(length-i < 4096 ? length-i : 4096, &data[i]);
+}
+
+// the non-ascii chars from all the files
+static Char* nonascii_chars = NULL;
+static int nonascii_length = 0;
+
+static void add_nonascii_chars(long length, const utf8 data[length]) {
+	Char* chars;
+	ALLOC(chars, length+1);
+	int count = utf8_decode(&(Utf8Decoder){0}, length, data, chars);
+	REALLOC(nonascii_chars, nonascii_length+count);
+	FOR (i, count)
+		if (chars[i] >= 128)
+			nonascii_chars[nonascii_length++] = chars[i];
+	free(chars);
+}
+
+// look up the widths of all the chars in `nonascii_chars` repeatedly
+static void bench_widths(const utf8* name, bool last) {
+	int passes = 0;
+	long total = 0; // (so the lookups aren't optimized out)
+	double start = now();
+	double time;
+	do {
+		FOR (i, nonascii_length)
+			total += unicode_width(nonascii_chars[i]);
+		passes++;
+		time = now()-start;
+	} while (time < MIN_TIME || passes < MIN_PASSES);
+	double chars = (double)nonascii_length*passes;
+	printf("\t\t{\"name\": \"%s\", \"chars\": %d, \"passes\": %d, \"total_width\": %ld, \"seconds\": %.4f, \"ns_per_char\": %.3f}%s\n", name, nonascii_length, passes, total/passes, time, time*1e9/chars, last ? "" : ",");
+}
+
+// name of the file without the directory or extension
+static void print_name(const utf8* path) {
+	const utf8* start = strrchr(path, '/');
+	start = start ? start+1 : path;
+	const utf8* end = strchr(start, '.');
+	printf("\"%.*s\"", end ? (int)(end-start) : (int)strlen(start), start);
+}
+
+int main(int argc, char* argv[argc+1]) {
+	debug_enabled = false;
+	// (only for comparing with wcwidth(), which needs a utf-8 locale)
+	if (!setlocale(LC_CTYPE, "C.UTF-8"))
+		setlocale(LC_CTYPE, "");
+	init_term(WIDTH, HEIGHT);
+	
+	printf("{\n");
+	printf("\t\"format\": 3,\n"); // (increase this if the output or corpus changes)
+	printf("\t\"width\": %d,\n", WIDTH);
+	printf("\t\"height\": %d,\n", HEIGHT);
+	printf("\t\"results\": [\n");
+	for (int i=1; i<argc; i++) {
+		long length;
+		utf8* data = read_file(argv[i], &length);
+		add_nonascii_chars(length, data);
+		
+		replay(length, data); // warm up
+		int passes = 0;
+		double start = now();
+		double time;
+		do {
+			replay(length, data);
+			passes++;
+			time = now()-start;
+		} while (time < MIN_TIME || passes < MIN_PASSES);
+		free(data);
+		
+		double bytes = (double)length*passes;
+		printf("\t\t{\"name\": ");
+		print_name(argv[i]);
+		printf(", \"bytes\": %ld, \"passes\": %d, \"seconds\": %.4f, \"mb_per_s\": %.2f, \"ns_per_byte\": %.3f}%s\n", length, passes, time, bytes/time/1e6, time*1e9/bytes, i<argc-1 ? "," : "");
+	}
+	printf("\t],\n");
+	printf("\t\"widths\": [\n");
+	bench_widths("table", false);
+	set_unicode_version("libc");
+	bench_widths("wcwidth", true);
+	printf("\t]\n");
+	printf("}\n");
+	return 0;
+}
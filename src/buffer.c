@@ -1,28 +1,21 @@
 // functions for controlling the text in the screen buffer
 
 #define _XOPEN_SOURCE 600
-#include <wchar.h>
+#include <stdio.h>
 #include <string.h>
+#include <assert.h>
 #include <unistd.h>
 
 #include "common.h"
 #include "buffer.h"
 #include "ctlseqs.h"
 #include "settings.h"
-#include "draw2.h"
+#include "host.h"
+#include "history.h"
+#include "unicode.h"
 
 Term T;
 
-static struct history {
-	Row** rows; // array of pointers
-	int size; // length of ring buffer
-		
-	int scroll; // visual scroll position
-		
-	int length; // number of rows stored currently
-	int head; // next empty slot
-} history;
-
 static void init_palette(void) {
 	T.foreground = settings.foreground;
 	T.background = settings.background;
@@ -30,39 +23,468 @@ static void init_palette(void) {
 	memcpy(T.palette, settings.palette, sizeof(T.palette));
 }
 
-static void free_history(void) {
-	if (history.rows) {
-		for (int i=1; i<=history.length; i++)
-			FREE(history.rows[(history.head-i+history.size) % history.size]);
+// == attribute table ==
+// cells store an index into T.attr_table rather than their full attributes.
+// entries are never removed individually: instead, when the table is almost full, the unused ones are removed all at once, and the rest are renumbered.
+// this means that AttrIds must not be stored anywhere except in rows, at the points where that can happen.
+
+#define ATTRS_MAX 65536
+
+static unsigned hash_attrs(const Attrs* attrs) {
+	const uint8_t* p = (const uint8_t*)attrs;
+	unsigned h = 2166136261u; // fnv-1a
+	FOR (i, sizeof(Attrs)) {
+		h ^= p[i];
+		h *= 16777619u;
 	}
+	return h;
 }
 
-// clear + init
-void init_history(void) {
-	free_history();
-	
-	history.size = settings.saveLines;
-	ALLOC(history.rows, history.size);
-	
-	history.head = 0;
-	history.length = 0;
-	
-	T.scroll = 0;
+// rebuild the hash table after the list changes
+static void reindex_attrs(void) {
+	struct attr_table* t = &T.attr_table;
+	int mask = t->size*2-1;
+	REALLOC(t->index, t->size*2);
+	memset(t->index, 0, sizeof(*t->index)*t->size*2);
+	FOR (i, t->length) {
+		unsigned h = hash_attrs(&t->items[i]) & mask;
+		while (t->index[h])
+			h = (h+1) & mask;
+		t->index[h] = i+1;
+	}
+	t->last = 0;
+}
+
+static void init_attr_table(void) {
+	struct attr_table* t = &T.attr_table;
+	t->size = 256;
+	t->length = 0;
+	ALLOC(t->items, t->size);
+	reindex_attrs();
+	// entry 0 is always the default attributes
+	intern_attrs((Attrs){
+		.color = {.i = -1},
+		.background = {.i = -2},
+	});
+}
+
+AttrId intern_attrs(Attrs attrs) {
+	struct attr_table* t = &T.attr_table;
+	// (usually the same attributes are looked up many times in a row)
+	if (t->length && !memcmp(&t->items[t->last], &attrs, sizeof(Attrs)))
+		return t->last;
+	int mask = t->size*2-1;
+	unsigned h = hash_attrs(&attrs) & mask;
+	for (; t->index[h]; h = (h+1) & mask) {
+		if (!memcmp(&t->items[t->index[h]-1], &attrs, sizeof(Attrs)))
+			return t->last = t->index[h]-1;
+	}
+	// add a new entry
+	if (t->length == t->size) {
+		if (t->size == ATTRS_MAX) {
+			print("attribute table is full\n");
+			return 0;
+		}
+		t->size *= 2;
+		REALLOC(t->items, t->size);
+		reindex_attrs();
+		return intern_attrs(attrs);
+	}
+	t->items[t->length] = attrs;
+	t->index[h] = t->length+1;
+	if (attrs.link)
+		ref_link(attrs.link);
+	return t->last = t->length++;
+}
+
+// remove the attributes which aren't used by any cell on the screen, and renumber the rest
+static void collect_attrs(void) {
+	struct attr_table* t = &T.attr_table;
+	bool* used = calloc(t->length, sizeof(bool));
+	used[0] = true;
+	FOR (scr, 2) {
+		FOR (y, T.height) {
+			Row* row = T.buffers[scr].rows[y];
+			FOR (x, T.width)
+				used[row->cells[x].attr] = true;
+		}
+	}
+	AttrId* renumber;
+	ALLOC(renumber, t->length);
+	int length = 0;
+	FOR (i, t->length) {
+		if (used[i]) {
+			renumber[i] = length;
+			t->items[length++] = t->items[i];
+		} else if (t->items[i].link) {
+			unref_link(t->items[i].link);
+		}
+	}
+	print("removed %d unused attributes (%d left)\n", t->length-length, length);
+	t->length = length;
+	FOR (scr, 2) {
+		FOR (y, T.height) {
+			Row* row = T.buffers[scr].rows[y];
+			FOR (x, T.width)
+				row->cells[x].attr = renumber[row->cells[x].attr];
+		}
+	}
+	free(used);
+	free(renumber);
+	reindex_attrs();
+	// any other copies of the cells are now wrong
+	history_forget_cache();
+	host.dirty_all();
+}
+
+// make sure there's room to add `count` more attributes.
+// this can remove unused attributes and renumber the rest, so it must only be called when there are no AttrIds in use outside of the rows (i.e. not in the middle of printing etc.)
+void reserve_attrs(int count) {
+	count = limit(count, 0, ATTRS_MAX/2);
+	if (T.attr_table.length+count > ATTRS_MAX)
+		collect_attrs();
+}
+
+// == cluster table ==
+// most cells have at most one combining char, which is stored in the cell.
+// when a cell has more (e.g. devanagari, emoji zwj sequences, or "zalgo" text), they're stored in T.clusters instead, and the cell refers to them.
+// this works like the attribute table: identical sequences are only stored once, and unused ones are removed when it fills up.
+// (since a sequence gets a new entry each time a char is added to it, floods of combining chars create a lot of garbage, so the table has a fixed maximum size)
+
+#define CLUSTERS_MAX (1<<20) // (in Chars)
+
+static unsigned hash_cluster(int length, const Char chars[length]) {
+	unsigned h = 2166136261u; // fnv-1a
+	FOR (i, length) {
+		h ^= chars[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+// rebuild the hash table after the entries change
+static void reindex_clusters(void) {
+	struct cluster_table* t = &T.clusters;
+	while (t->index_size < t->count+1)
+		t->index_size = t->index_size ? t->index_size*2 : 64;
+	int mask = t->index_size*2-1;
+	REALLOC(t->index, t->index_size*2);
+	memset(t->index, 0, sizeof(*t->index)*t->index_size*2);
+	for (int i=0; i<t->length; i+=t->items[i]+1) {
+		unsigned h = hash_cluster(t->items[i], &t->items[i+1]) & mask;
+		while (t->index[h])
+			h = (h+1) & mask;
+		t->index[h] = i+1;
+	}
+}
+
+// get the value for Cell.combining, for a sequence of combining chars
+// returns 0 if the table is full
+Char intern_cluster(int length, const Char chars[length]) {
+	if (length<=1)
+		return length ? chars[0] : 0;
+	struct cluster_table* t = &T.clusters;
+	if (!t->index)
+		reindex_clusters();
+	int mask = t->index_size*2-1;
+	unsigned h = hash_cluster(length, chars) & mask;
+	for (; t->index[h]; h = (h+1) & mask) {
+		Char* item = &t->items[t->index[h]-1];
+		if (item[0]==length && !memcmp(&item[1], chars, sizeof(Char)*length))
+			return CLUSTER + t->index[h]-1;
+	}
+	// add a new entry
+	if (t->length+length+1 > CLUSTERS_MAX) {
+		print("cluster table is full\n");
+		return 0;
+	}
+	if (t->length+length+1 > t->size) {
+		while (t->length+length+1 > t->size)
+			t->size = t->size ? t->size*2 : 1024;
+		REALLOC(t->items, t->size);
+	}
+	int pos = t->length;
+	t->items[pos] = length;
+	memcpy(&t->items[pos+1], chars, sizeof(Char)*length);
+	t->length += length+1;
+	t->count++;
+	if (t->count+1 > t->index_size)
+		reindex_clusters();
+	else
+		t->index[h] = pos+1;
+	return CLUSTER + pos;
+}
+
+// get the combining chars of a cell. returns how many there are, and sets `*chars` to point to them
+// (this pointer is only valid until the cell or T.clusters changes)
+int cell_combining(const Cell* cell, const Char** chars) {
+	if (cell->combining >= CLUSTER) {
+		const Char* item = &T.clusters.items[cell->combining-CLUSTER];
+		*chars = &item[1];
+		return item[0];
+	}
+	*chars = &cell->combining;
+	return cell->combining ? 1 : 0;
+}
+
+// remove the entries which aren't used by any cell on the screen, and renumber the rest
+static void collect_clusters(void) {
+	struct cluster_table* t = &T.clusters;
+	// position of each entry after the table is compacted (-1 = unused)
+	int* renumber;
+	ALLOC(renumber, t->length);
+	FOR (i, t->length)
+		renumber[i] = -1;
+	FOR (scr, 2) {
+		FOR (y, T.height) {
+			Row* row = T.buffers[scr].rows[y];
+			FOR (x, T.width) {
+				if (row->cells[x].combining >= CLUSTER)
+					renumber[row->cells[x].combining-CLUSTER] = 0;
+			}
+		}
+	}
+	int length = 0;
+	int count = 0;
+	for (int i=0; i<t->length; ) {
+		int size = t->items[i]+1;
+		if (renumber[i] >= 0) {
+			renumber[i] = length;
+			memmove(&t->items[length], &t->items[i], sizeof(Char)*size);
+			length += size;
+			count++;
+		}
+		i += size;
+	}
+	print("removed %d unused clusters (%d left)\n", t->count-count, count);
+	t->length = length;
+	t->count = count;
+	FOR (scr, 2) {
+		FOR (y, T.height) {
+			Row* row = T.buffers[scr].rows[y];
+			FOR (x, T.width) {
+				if (row->cells[x].combining >= CLUSTER)
+					row->cells[x].combining = CLUSTER + renumber[row->cells[x].combining-CLUSTER];
+			}
+		}
+	}
+	free(renumber);
+	reindex_clusters();
+	// any other copies of the cells are now wrong
+	history_forget_cache();
 }
 
-static void clear_row(Row* row, int start, bool bce) {
+// make sure there's room to add `count` more clusters.
+// (like reserve_attrs(), this must only be called when there are no cluster references outside of the rows)
+void reserve_clusters(int count) {
+	count = limit(count, 0, CLUSTERS_MAX/(CLUSTER_MAX+1)/2);
+	if (T.clusters.length+count*(CLUSTER_MAX+1) > CLUSTERS_MAX)
+		collect_clusters();
+}
+
+// == hyperlink table ==
+// OSC 8 links are interned: a link with the same id and url as an existing one gets the same number (so e.g. running `ls --hyperlink` repeatedly doesn't keep adding links).
+// a link is referenced by the attribute table entries which use it, and by the history blocks which have rows that use it, and it's freed when the last of these goes away.
+// the cursor (and the saved cursors) can also use a link without holding a reference, so links with no references are kept in `unused` until the cursor is done with them.
+
+#define LINKS_MAX 65535 // (Attrs.link is 16 bits)
+
+static unsigned hash_string(unsigned h, const utf8* s) {
+	do {
+		h ^= (unsigned char)*s;
+		h *= 16777619u;
+	} while (*s++);
+	return h;
+}
+
+static unsigned hash_link(const utf8* id, const utf8* url) {
+	return hash_string(hash_string(2166136261u, id), url); // fnv-1a
+}
+
+// rebuild the hash table after it gets too full
+static void reindex_links(void) {
+	struct link_table* t = &T.links;
+	while (t->index_size < t->count*2)
+		t->index_size = t->index_size ? t->index_size*2 : 64;
+	REALLOC(t->index, t->index_size);
+	memset(t->index, 0, sizeof(*t->index)*t->index_size);
+	FOR (i, t->length) {
+		struct link* l = &t->items[i];
+		if (!l->url)
+			continue;
+		unsigned h = hash_link(l->id, l->url) & (t->index_size-1);
+		l->next = t->index[h];
+		t->index[h] = i+1;
+	}
+}
+
+static bool cursor_link(int link) {
+	return T.c.attrs.link==link || T.buffers[0].saved_cursor.attrs.link==link || T.buffers[1].saved_cursor.attrs.link==link;
+}
+
+static void free_link(int link) {
+	struct link_table* t = &T.links;
+	struct link* l = &t->items[link-1];
+	// remove it from its chain
+	int* p = &t->index[hash_link(l->id, l->url) & (t->index_size-1)];
+	while (*p != link)
+		p = &t->items[*p-1].next;
+	*p = l->next;
+	free(l->id); // (the url is in the same allocation)
+	l->id = l->url = NULL;
+	l->next = t->free;
+	t->free = link;
+	t->count--;
+}
+
+static void add_unused(int link) {
+	struct link_table* t = &T.links;
+	FOR (i, t->unused_length)
+		if (t->unused[i]==link)
+			return;
+	if (t->unused_length == t->unused_size) {
+		t->unused_size = t->unused_size ? t->unused_size*2 : 8;
+		REALLOC(t->unused, t->unused_size);
+	}
+	t->unused[t->unused_length++] = link;
+}
+
+// free the links with no references that the cursor isn't using anymore
+static void free_unused_links(void) {
+	struct link_table* t = &T.links;
+	int length = 0;
+	FOR (i, t->unused_length) {
+		int link = t->unused[i];
+		if (!t->items[link-1].url || t->items[link-1].refs)
+			continue;
+		if (cursor_link(link))
+			t->unused[length++] = link;
+		else
+			free_link(link);
+	}
+	t->unused_length = length;
+}
+
+void ref_link(int link) {
+	T.links.items[link-1].refs++;
+}
+
+void unref_link(int link) {
+	if (--T.links.items[link-1].refs)
+		return;
+	if (cursor_link(link))
+		add_unused(link);
+	else
+		free_link(link);
+}
+
+// get the link number for an id (or "") and url
+// returns 0 if the table is full
+int intern_link(const utf8* id, const utf8* url) {
+	struct link_table* t = &T.links;
+	free_unused_links();
+	unsigned h = hash_link(id, url);
+	if (t->index_size) {
+		for (int n=t->index[h & (t->index_size-1)]; n; n=t->items[n-1].next) {
+			struct link* l = &t->items[n-1];
+			if (!strcmp(l->url, url) && !strcmp(l->id, id))
+				return n;
+		}
+	}
+	// add a new entry
+	int link = t->free;
+	if (link) {
+		t->free = t->items[link-1].next;
+	} else {
+		if (t->length == LINKS_MAX) {
+			print("hyperlink table is full\n");
+			return 0;
+		}
+		if (t->length == t->size) {
+			t->size = t->size ? t->size*2 : 64;
+			REALLOC(t->items, t->size);
+		}
+		link = ++t->length;
+	}
+	struct link* l = &t->items[link-1];
+	int id_length = strlen(id);
+	ALLOC(l->id, id_length+1+strlen(url)+1);
+	strcpy(l->id, id);
+	l->url = strcpy(l->id+id_length+1, url);
+	l->refs = 0;
+	t->count++;
+	if (t->count*2 > t->index_size) {
+		reindex_links();
+	} else {
+		l->next = t->index[h & (t->index_size-1)];
+		t->index[h & (t->index_size-1)] = link;
+	}
+	// (nothing refers to it until it's printed)
+	add_unused(link);
+	return link;
+}
+
+// make sure there's room to add `count` more links.
+// links are mostly kept alive by old entries in the attribute table, so this collects that (and the same rules as reserve_attrs() apply)
+void reserve_links(int count) {
+	count = limit(count, 0, LINKS_MAX/2);
+	if (T.links.count+count > LINKS_MAX)
+		collect_attrs();
+}
+
+// get the url of a link (or NULL)
+const utf8* link_url(int link) {
+	if (link<1 || link>T.links.length)
+		return NULL;
+	return T.links.items[link-1].url;
+}
+
+// clear the cells from `start` to the end of the row
+void clear_row(Row* row, int start, bool bce) {
+	Cell blank = {
+		.chr=0,
+		.attr = intern_attrs((Attrs){
+			.color = T.c.attrs.color,
+			.background = bce ? T.c.attrs.background : (Color){.i=-2},
+		}),
+	};
 	for (int i=start; i<T.width; i++) {
 		// todo: check for wide char halves!
-		row->cells[i] = (Cell){
-			.chr=0,
-			.attrs = {
-				.color = T.c.attrs.color,
-				.background = bce ? T.c.attrs.background : (Color){.i=-2},
-			},
-		};
+		row->cells[i] = blank;
 	}
 	row->wrap = false;
 	row->cont = false;
+	touch_cells(row, start, T.width);
+}
+
+// rows which aren't in use, kept so they can be reused without allocating
+// (rows are taken from and given back to this when the screen is resized)
+// these are always T.width cells wide
+static struct row_pool {
+	Row* rows[64];
+	int length;
+} row_pool;
+
+// get an uninitialized row with T.width cells
+static Row* alloc_row(void) {
+	Row* row = row_pool.length ? row_pool.rows[--row_pool.length] : malloc(sizeof(Row) + sizeof(Cell)*T.width);
+	touch_row(row);
+	return row;
+}
+
+// give back a row with T.width cells (or NULL)
+static void free_row(Row* row) {
+	if (row_pool.length < LEN(row_pool.rows))
+		row_pool.rows[row_pool.length++] = row;
+	else
+		free(row);
+}
+
+// empty the pool (when the width changes)
+static void flush_row_pool(void) {
+	FOR (i, row_pool.length)
+		free(row_pool.rows[i]);
+	row_pool.length = 0;
 }
 
 void term_free(void) {
@@ -73,47 +495,14 @@ void term_free(void) {
 	}
 	free(T.tabs);
 	free_history();
-}
-
-static void incwrap(int* x, int range) {
-	(*x)++;
-	if (*x >= range)
-		*x = 0;
-}
-
-// return: a row removed from history, or NULL
-// this row is owned by the caller
-static Row* pop_history(void) {
-	// check length
-	if (history.length<=0)
-		return NULL;
-	// move head backwards
-	if (history.head>0)
-		history.head--;
-	else
-		history.head = history.size-1;
-	// return item
-	history.length--;
-	// we don't need to set history.rows[history.head] to NULL, i think
-	return history.rows[history.head];
+	flush_row_pool();
 }
 
 // idea: scroll lock support
 static void push_history(int y) {
 	if (y<0 || y>=T.height)
 		return;
-	// free oldest item if necessary
-	if (history.length == history.size) {
-		FREE(history.rows[history.head]);
-	} else {
-		history.length++;
-	}
-	// move row into history
-	Row* new = T.buffers[0].rows[y];
-	history.rows[history.head] = new;
-	T.buffers[0].rows[y] = NULL; // set to null so it doesn't get freed
-	// move head forward to next slot
-	incwrap(&history.head, history.size);
+	history_push(*buffer_row(&T.buffers[0], y));
 	// adjust scroll offset if we are scrolled up currently
 	if (T.scroll>0)
 		T.scroll++;
@@ -124,6 +513,7 @@ static void push_history(int y) {
 // the return value is the same thing assigned to *row
 Row* resize_row(Row** row, int size, int old_size) {
 	*row = realloc(*row, sizeof(Row) + sizeof(Cell)*size);
+	touch_row(*row);
 	if (size > old_size)
 		clear_row(*row, old_size, true);
 	(*row)->wrap = false;
@@ -131,22 +521,270 @@ Row* resize_row(Row** row, int size, int old_size) {
 	return *row;
 }
 
+// rearrange the rows of a buffer so that .base is 0
+static void unrotate_buffer(Buffer* buf) {
+	if (!buf->base)
+		return;
+	Row** rows;
+	ALLOC(rows, T.height);
+	FOR (y, T.height)
+		rows[y] = *buffer_row(buf, y);
+	free(buf->rows);
+	buf->rows = rows;
+	buf->base = 0;
+}
+
+// == reflow ==
+// when the width changes, the lines on the main screen (sequences of rows that wrap onto the next one) are joined and wrapped again at the new width.
+// the alt screen isn't reflowed, since programs that use it redraw it when the size changes anyway.
+
+// a row that's being re-wrapped
+typedef struct ReflowRow {
+	Row* row;
+	int cells; // number of cells in it which are part of its line
+	AttrId fill; // attributes of the blank cells after it, if it's the end of a line
+} ReflowRow;
+
+// a position on the main screen which should stay on the same text
+typedef struct ReflowPos {
+	int* x;
+	int* y;
+	int64_t offset; // position in its line
+	bool past; // whether it was past the right edge
+	bool home; // whether it was at the start of the last row of a wrapped line (after a carriage return)
+	int row, col; // new position (row is an index into the reflowed rows)
+} ReflowPos;
+
+// (lines longer than this which started in the history are only partially re-wrapped)
+#define REFLOW_PULL_MAX 1000
+
+static ReflowRow reflow_row(Row* row, int width) {
+	AttrId fill = row->cells[width-1].attr;
+	int length = width;
+	if (!row->wrap) {
+		// trim blank cells
+		while (length>0) {
+			Cell* c = &row->cells[length-1];
+			if (c->chr || c->combining || c->wide || c->attr!=fill)
+				break;
+			length--;
+		}
+	}
+	return (ReflowRow){row, length, fill};
+}
+
+// re-wrap the main screen to T.width (its rows currently have `old_width` cells)
+static void reflow_main(int old_width) {
+	if (!T.height) // (the screen is being created)
+		return;
+	Buffer* buf = &T.buffers[0];
+	bool current = T.current==buf;
+	ReflowPos pos[3] = {
+		{&buf->saved_cursor.x, &buf->saved_cursor.y},
+	};
+	int positions = 1;
+	if (current) {
+		// the cursor goes first, since it's the one that stays on screen
+		pos[1] = pos[0];
+		pos[0] = (ReflowPos){&T.c.x, &T.c.y};
+		pos[2] = (ReflowPos){&T.last_x, &T.last_y};
+		positions = 3;
+	}
+	FOR (p, positions)
+		pos[p].row = -1;
+	
+	// pull back any line that started in the history, so it gets re-wrapped along with the screen
+	// (these rows are already at the new width)
+	int pulled = 0;
+	ReflowRow* rows = NULL;
+	while (pulled<REFLOW_PULL_MAX && (pulled ? rows[pulled-1].row : buf->rows[0])->cont) {
+		Row* row = malloc(sizeof(Row) + sizeof(Cell)*T.width);
+		int cells = history_pop(row);
+		if (cells<0) {
+			free(row);
+			break;
+		}
+		REALLOC(rows, pulled+1);
+		rows[pulled++] = (ReflowRow){row, row->wrap ? cells : reflow_row(row, T.width).cells, row->cells[T.width-1].attr};
+	}
+	int count = pulled+T.height;
+	REALLOC(rows, count);
+	// (they were popped newest first)
+	FOR (i, pulled/2) {
+		ReflowRow temp = rows[i];
+		rows[i] = rows[pulled-1-i];
+		rows[pulled-1-i] = temp;
+	}
+	FOR (y, T.height)
+		rows[pulled+y] = reflow_row(buf->rows[y], old_width);
+	
+	Row** out = NULL;
+	int length = 0;
+	for (int i=0; i<count; ) {
+		// find the end of the line
+		int end = i+1;
+		while (end<count && rows[end-1].row->wrap && rows[end].row->cont)
+			end++;
+		AttrId fill = rows[end-1].fill;
+		// find the positions that are in this line
+		bool in_line[3] = {false};
+		int64_t offset = 0;
+		for (int j=i; j<end; j++) {
+			FOR (p, positions) {
+				if (*pos[p].y+pulled != j)
+					continue;
+				in_line[p] = true;
+				// (a cursor past the right edge stays past the right edge)
+				pos[p].past = *pos[p].x>=old_width;
+				pos[p].offset = offset + *pos[p].x - pos[p].past;
+				pos[p].home = j>i && j==end-1 && *pos[p].x==0;
+				pos[p].row = -1;
+			}
+			offset += rows[j].cells;
+		}
+		
+		// split it into rows
+		REALLOC(out, length+1);
+		out[length++] = alloc_row();
+		out[length-1]->cont = rows[i].row->cont;
+		int x = 0;
+		offset = 0;
+		for (int j=i; j<end; j++) {
+			FOR (c, rows[j].cells) {
+				Cell cell = rows[j].row->cells[c];
+				// start a new row when this one is full (or when a wide char doesn't fit)
+				if (x==T.width || x==T.width-1 && cell.wide==1) {
+					for (; x<T.width; x++)
+						out[length-1]->cells[x] = (Cell){.attr = fill};
+					out[length-1]->wrap = true;
+					REALLOC(out, length+1);
+					out[length++] = alloc_row();
+					out[length-1]->cont = true;
+					x = 0;
+				}
+				// (the right half of a wide char that was split)
+				if (x==0 && cell.wide==-1)
+					cell = (Cell){.attr = cell.attr};
+				FOR (p, positions) {
+					if (in_line[p] && pos[p].offset==offset+c) {
+						pos[p].row = length-1;
+						pos[p].col = x;
+					}
+				}
+				out[length-1]->cells[x++] = cell;
+			}
+			offset += rows[j].cells;
+		}
+		// positions after the end of the line
+		FOR (p, positions) {
+			if (in_line[p] && pos[p].row<0) {
+				int64_t col = x + pos[p].offset-offset;
+				// (right after the end of a full row: past the right edge of it)
+				if (col == T.width)
+					col--, pos[p].past = true;
+				pos[p].row = length-1 + col/T.width;
+				pos[p].col = col%T.width;
+			}
+			if (in_line[p])
+				pos[p].col += pos[p].past;
+			// (so that a newline after it still goes below the line)
+			if (in_line[p] && pos[p].home && pos[p].row<=length-1) {
+				pos[p].row = length-1;
+				pos[p].col = 0;
+			}
+		}
+		for (; x<T.width; x++)
+			out[length-1]->cells[x] = (Cell){.attr = fill};
+		out[length-1]->wrap = false;
+		// (add blank rows if a position is below the end of the line)
+		FOR (p, positions) {
+			while (in_line[p] && pos[p].row >= length) {
+				REALLOC(out, length+1);
+				out[length++] = alloc_row();
+				clear_row(out[length-1], 0, true);
+			}
+		}
+		i = end;
+	}
+	
+	// remove blank rows below the cursor rather than pushing lines off the top
+	while (length>T.height && length-1>pos[0].row) {
+		Row* row = out[length-1];
+		if (row->cont || reflow_row(row, T.width).cells)
+			break;
+		free_row(row);
+		length--;
+	}
+	// put lines that don't fit into the history
+	int top = length-T.height;
+	FOR (i, top) {
+		history_push(out[i]);
+		free_row(out[i]);
+	}
+	if (top < 0)
+		top = 0;
+	// or bring lines back from the history, to fill the space
+	Row** above;
+	ALLOC(above, T.height);
+	int shift = 0;
+	while (length-top+shift < T.height) {
+		Row* row = alloc_row();
+		if (history_pop(row)<0) {
+			free_row(row);
+			break;
+		}
+		above[shift++] = row;
+	}
+	
+	FOR (y, T.height)
+		free(rows[pulled+y].row);
+	int y = 0;
+	// (these were popped newest first)
+	for (int i=shift-1; i>=0; i--)
+		buf->rows[y++] = above[i];
+	for (int i=top; i<length; i++)
+		buf->rows[y++] = out[i];
+	// and fill the rest with blank rows
+	for (; y<T.height; y++) {
+		buf->rows[y] = alloc_row();
+		clear_row(buf->rows[y], 0, true);
+	}
+	FOR (i, pulled)
+		free(rows[i].row);
+	free(rows);
+	free(out);
+	free(above);
+	
+	FOR (p, positions) {
+		if (pos[p].row < 0) // (it was off the screen)
+			continue;
+		*pos[p].y = limit(pos[p].row-top+shift, 0, T.height-1);
+		*pos[p].x = limit(pos[p].col, 0, T.width);
+	}
+	// (this counts the whole history, so only do it if it's needed)
+	if (T.scroll)
+		T.scroll = limit(T.scroll, 0, history_length());
+}
+
 // this sets T.width and T.height
 // please do NOT change those variables manually
 void term_resize(int width, int height) {
 	print("resizing screen from %dx%d to %dx%d\n", T.width, T.height, width, height);
 	
+	// put the rows back in order, so the code below can treat them as a plain array
+	FOR (scr, 2)
+		unrotate_buffer(&T.buffers[scr]);
+	
 	if (width != T.width) {
 		int old_width = T.width;
 		T.width = width;
-		// resize existing rows
-		// todo: option to re-wrap text?
-		FOR (scr, 2) {
-			FOR (y, T.height)
-				resize_row(&T.buffers[scr].rows[y], T.width, old_width);
-		}
+		flush_row_pool();
+		history_reflow();
+		reflow_main(old_width);
+		// alt screen: just cut off or extend the rows
+		FOR (y, T.height)
+			resize_row(&T.buffers[1].rows[y], T.width, old_width);
 		// adjust last_written pos
-		// todo: remember to update this when text re-wrapping is added
 		T.last_x = limit(T.last_x, 0, T.width);
 		// update tab stops
 		REALLOC(T.tabs, T.width+1);
@@ -155,11 +793,6 @@ void term_resize(int width, int height) {
 		// adjust cursor position
 		T.c.x = limit(T.c.x, 0, T.width); //note this is NOT width-1, since cursor is allowed to be in the right margin
 		// T.saved_cursor.x = limit(T.saved_cursor.x, 0, T.width); // I used to limit the saved cursor pos here, but i think that's wrong, since it's limited when restored anyway? honsestly i'm not sure. it only makes a difference if the window is resized smaller, then larger again.
-		// resize history rows
-		for (int i=1; i<=history.length; i++) {
-			Row** row = &history.rows[(history.head-i+history.size) % history.size];
-			resize_row(row, T.width, old_width);
-		}
 	}
 	
 	int diff = height-T.height;
@@ -170,8 +803,9 @@ void term_resize(int width, int height) {
 		for (; y < -diff; y++) {
 			// main buffer: put lines into history
 			push_history(y);
+			free_row(T.buffers[0].rows[y]);
 			// alt buffer: free
-			free(T.buffers[1].rows[y]);
+			free_row(T.buffers[1].rows[y]);
 		}
 		// lower rows: shift upwards
 		for (; y<T.height; y++)
@@ -200,14 +834,13 @@ void term_resize(int width, int height) {
 		/// upper rows:
 		for (; y>=0; y--) {
 			// main buffer: move rows out of history
-			Row* r = pop_history();
-			T.buffers[0].rows[y] = r;
-			if (!r) // history empty; blank row
-				resize_row(&T.buffers[0].rows[y], T.width, 0);
+			T.buffers[0].rows[y] = alloc_row();
+			if (history_pop(T.buffers[0].rows[y]) < 0) // history empty; blank row
+				clear_row(T.buffers[0].rows[y], 0, true);
 			
 			// alt buffer: insert blank row
-			T.buffers[1].rows[y] = NULL;
-			resize_row(&T.buffers[1].rows[y], T.width, 0);
+			T.buffers[1].rows[y] = alloc_row();
+			clear_row(T.buffers[1].rows[y], 0, true);
 		}
 		// adjust cursor down
 		T.c.y += diff;
@@ -256,17 +889,18 @@ void clear_region(int x1, int y1, int x2, int y2) {
 		y2 = T.height;
 	// todo: handle wide chars
 	
+	Cell blank = {
+		.chr=0,
+		.attr = intern_attrs((Attrs){
+			.color = T.c.attrs.color,
+			.background = T.c.attrs.background,
+		}),
+	};
 	for (int y=y1; y<y2; y++) {
-		Row* row = T.current->rows[y];
-		for (int x=x1; x<x2; x++) {
-			row->cells[x] = (Cell){
-				.chr=0,
-				.attrs = {
-					.color = T.c.attrs.color,
-					.background = T.c.attrs.background,
-				},
-			};
-		}
+		Row* row = current_row(y);
+		touch_cells(row, x1, x2);
+		for (int x=x1; x<x2; x++)
+			row->cells[x] = blank;
 		// only unset these flags if the region goes to the edge
 		if (x1<=0)
 			row->cont = false;
@@ -310,23 +944,14 @@ void full_reset(void) {
 	T.app_cursor = false;
 	T.mouse_mode = 0;
 	T.mouse_encoding = 0;
+	T.synchronized = false;
 	
-	FOR (i, T.links.length)
-		free(T.links.items[i]);
-	T.links.length = 0;
+	// (the cursor's link was reset)
+	free_unused_links();
 	
 	reset_parser();
 }
 
-// todo: um we need to free these??
-int new_link(utf8* url) {
-	if (T.links.length < LEN(T.links.items))
-		if ((T.links.items[T.links.length] = strdup(url)))
-			return T.links.length++;
-	print("failed to allocate hyperlink\n");
-	return -1;
-}
-
 // only call this ONCE
 // make sure it's after settings are loaded
 void init_term(int width, int height) {
@@ -340,46 +965,57 @@ void init_term(int width, int height) {
 			},
 		},
 	};
+	if (!set_unicode_version(settings.unicodeVersion))
+		fprintf(stderr, "12term: no char width table for unicodeVersion %s, using Unicode %s\n", settings.unicodeVersion, unicode_version());
+	init_attr_table();
 	term_resize(width, height);
 	full_reset();
 	init_history();
 }
 
-// generic array rotate function
-static void memswap(int size, uint8_t a[size], uint8_t b[size]) {
-	uint8_t temp[size];
-	memcpy(temp, a, size);
-	memcpy(a, b, size);
-	memcpy(b, temp, size);
-}
-static void rotate(int count, int itemsize, uint8_t data[count][itemsize], int amount) {
-	while (amount<0)
-		amount += count;
+// rotate the rows in [`y1`,`y2`) by `amount` (negative = up, positive = down)
+static void rotate_rows(int y1, int y2, int amount) {
+	int count = y2-y1;
 	amount %= count;
-	int a=0;
-	int b=0;
-	
-	FOR (i, count) {
-		b = (b+amount) % count;
-		if (b==a)
-			b = ++a;
-		if (b!=a)
-			memswap(itemsize, data[a], data[b]);
+	if (amount<0)
+		amount += count;
+	if (!amount)
+		return;
+	if (count==T.height) {
+		// whole screen: just move the start of the ring
+		int base = T.current->base-amount;
+		if (base<0)
+			base += T.height;
+		T.current->base = base;
+		return;
+	}
+	// otherwise, move each row to its new position, following the cycles
+	int moved = 0;
+	for (int start=0; moved<count; start++) {
+		Row* row = *buffer_row(T.current, y1+start);
+		int i = start;
+		do {
+			i = (i+amount) % count;
+			Row** dest = buffer_row(T.current, y1+i);
+			Row* temp = *dest;
+			*dest = row;
+			row = temp;
+			moved++;
+		} while (i!=start);
 	}
 }
-#define ROTATE(array, length, amount) (rotate((length), sizeof(*(array)), (void*)(array), (amount)))
 
 // shift the rows in [`y1`,`y2`) by `amount` (negative = up, positive = down)
 // and clear the "new" lines
 static void shift_rows(int y1, int y2, int amount, bool bce) {
-	ROTATE(&T.current->rows[y1], y2-y1, amount);
-	draw_rotate_rows(y1, y2, amount, false);
+	rotate_rows(y1, y2, amount);
+	host.rotate_rows(y1, y2, amount, false);
 	if (amount>0) { // down
 		for (int y=y1; y<y1+amount; y++)
-			clear_row(T.current->rows[y], 0, bce);
+			clear_row(current_row(y), 0, bce);
 	} else { // up
 		for (int y=y2+amount; y<y2; y++)
-			clear_row(T.current->rows[y], 0, bce);
+			clear_row(current_row(y), 0, bce);
 	}
 	
 }
@@ -400,8 +1036,6 @@ static void scroll_up_internal(int amount, bool bce) {
 		for (int y=y1; y<y1+amount; y++) {
 		// if we are on the main screen, and the scroll region starts at the top of the screen, we add the lines to the history list.
 			push_history(y);
-			// wait but don't we need to clear this?  memory?
-			T.current->rows[y] = malloc(sizeof(Row) + sizeof(Cell)*T.width);
 		}
 	shift_rows(y1, y2, -amount, bce);
 }
@@ -522,14 +1156,13 @@ static const Char DEC_GRAPHICS_CHARSET[128] = {
 };
 
 static int char_width(Char c) {
-	int width;
-	if (c<128) { // assume ascii chars are never wide, to avoid calling wcwidth all the time // wait this includes control chars though? todo: dont print those unless we already filter them
+	if (c<128) // assume ascii chars are never wide, to avoid looking them up all the time // wait this includes control chars though? todo: dont print those unless we already filter them
+		return 1;
+	int width = unicode_width(c);
+	// a wide char can't fit on a 1 column screen, so it's printed as a normal one
+	// (the printing functions rely on this: they'd write past the end of the row, or never make progress)
+	if (width > T.width)
 		width = 1;
-	} else {
-		width = wcwidth(c);
-		if (width<0)
-			width = 1;
-	}
 	return width;
 }
 
@@ -539,7 +1172,7 @@ static int char_width(Char c) {
 static void clean_wc_left(Cell* dest, int x) {
 	if (x-1 >= 0 && dest[-1].wide==1)
 		dest[-1] = (Cell){
-			.attrs = dest[-1].attrs,
+			.attr = dest[-1].attr,
 			// rest are 0
 		};
 }
@@ -550,17 +1183,23 @@ static void clean_wc_left(Cell* dest, int x) {
 static void clean_wc_right(Cell* dest2, int x2) {
 	if (x2 < T.width && dest2->wide==-1)
 		*dest2 = (Cell){
-			.attrs = dest2->attrs,
+			.attr = dest2->attr,
 			// rest are 0
 		};
 }
 
+// mark cells `x1`…`x2-1` as changed, after printing chars there
+// (along with the cells on either side, where clean_wc_left/right might have removed half of a wide char)
+static void touch_span(Row* row, int x1, int x2) {
+	touch_cells(row, x1>0 ? x1-1 : 0, x2<T.width ? x2+1 : T.width);
+}
+
 // add a dummy cell at `left+1`, to the wide char at `left`
 // ⚠ `left` MUST NOT be the last cell in a row
 static void add_dummy(Cell* left) {
 	left[1] = (Cell){
 		.chr = 0,
-		.attrs = left->attrs, // do we really need to copy these attrs or can we just handle that during rendering? I do realize that copying the background etc makes it easier to erase, though
+		.attr = left->attr, // do we really need to copy these attrs or can we just handle that during rendering? I do realize that copying the background etc makes it easier to erase, though
 		.wide = -1,
 	};
 }
@@ -575,7 +1214,8 @@ static bool add_combining_char(Char c) {
 	// note that we don't alter the `last` flag/position, or the cursor,
 	// so subsequent combining chars are printed to the same cell
 	
-	Cell* dest = &T.current->rows[y]->cells[x];
+	Row* row = current_row(y);
+	Cell* dest = &row->cells[x];
 	// if this is the right half of a fullwidth char, move to the left
 	if (dest->wide==-1) {
 		if (x==0) {
@@ -587,26 +1227,64 @@ static bool add_combining_char(Char c) {
 		// todo: what if there is glitched data, and it ends up on another dummy char?
 	}
 	
-	// insert into the list
-	FOR (i, LEN(dest->combining)) {
-		if (dest->combining[i]==0) {
-			dest->combining[i] = c;
-			if (i+1<LEN(dest->combining))
-				dest->combining[i+1] = 0; // nul terminate
-			return true;
+	// add it to the end of the list
+	const Char* old;
+	int length = cell_combining(dest, &old);
+	if (length >= CLUSTER_MAX) {
+		print("too many combining chars in cell %d,%d!\n", x, y);
+		return false;
+	}
+	Char chars[CLUSTER_MAX];
+	memcpy(chars, old, sizeof(Char)*length);
+	chars[length] = c;
+	Char combining = intern_cluster(length+1, chars);
+	if (!combining)
+		return false;
+	dest->combining = combining;
+	touch_cells(row, x, x+1);
+	return true;
+}
+
+// the attributes that printed chars actually get stored with
+// (reverse and bold are applied here rather than in the renderer)
+// attributes for printed chars
+static AttrId print_attrs(void) {
+	Attrs a = T.c.attrs;
+	if (T.c.attrs.reverse) {
+		a.color = T.c.attrs.background;
+		a.background = T.c.attrs.color;
+	}
+	if (T.c.attrs.weight==1) { // mm we do this after reverse right?
+		if (!a.color.truecolor) {
+			int i = a.color.i;
+			if (i>=0 && i<8)
+				a.color.i += 8;
 		}
 	}
-	// failed
-	print("too many combining chars in cell %d,%d!\n", x, y);
-	return false;
+	return intern_attrs(a);
 }
 
-void put_char(Char c) {
-	// note: ref xterm/util.c/WriteText, xterm/screen.c/ScrnWriteText
+// if a char of `width` cells doesn't fit on the current line, move to the start of the next one
+static void wrap_for(int width) {
+	if (T.c.x+width > T.width) {
+		current_row(T.c.y)->wrap = true;
+		forward_index(1);
+		T.c.x = 0;
+		current_row(T.c.y)->cont = true;
+	}
+}
+
+static Char translate_char(Char c) {
 	if (T.charsets[0] == '0') {
 		if (c<128 && c>=0 && DEC_GRAPHICS_CHARSET[c])
 			c = DEC_GRAPHICS_CHARSET[c];
 	}
+	return c;
+}
+
+void put_char(Char c) {
+	// note: ref xterm/util.c/WriteText, xterm/screen.c/ScrnWriteText
+	c = translate_char(c);
 	
 	int width = char_width(c);
 	
@@ -615,15 +1293,11 @@ void put_char(Char c) {
 		return;
 	}
 	
-	// wrap
-	if (T.c.x+width > T.width) {
-		T.current->rows[T.c.y]->wrap = true;
-		forward_index(1);
-		T.c.x = 0;
-		T.current->rows[T.c.y]->cont = true;
-	}
+	wrap_for(width);
 	
-	Cell* dest = &T.current->rows[T.c.y]->cells[T.c.x];
+	Row* row = current_row(T.c.y);
+	touch_span(row, T.c.x, T.c.x+width);
+	Cell* dest = &row->cells[T.c.x];
 	// technically we'll only ever have to do one of these, but it's easier to check both rather than keeping track... (though, we could save on bounds checks too...)
 	clean_wc_left(dest, T.c.x);
 	clean_wc_right(&dest[width], T.c.x+width);
@@ -631,19 +1305,8 @@ void put_char(Char c) {
 	*dest = (Cell){
 		.chr = c,
 		.wide = width==2,
-		.attrs = T.c.attrs,
+		.attr = print_attrs(),
 	};
-	if (T.c.attrs.reverse) {
-		dest->attrs.color = T.c.attrs.background;
-		dest->attrs.background = T.c.attrs.color;
-	}
-	if (T.c.attrs.weight==1) { // mm we do this after reverse right?
-		if (!dest->attrs.color.truecolor) {
-			int i = dest->attrs.color.i;
-			if (i>=0 && i<8)
-				dest->attrs.color.i += 8;
-		}
-	}
 	
 	if (width==2)
 		add_dummy(dest);
@@ -654,8 +1317,126 @@ void put_char(Char c) {
 	T.last_y = T.c.y;
 	
 	T.c.x += width;
-	//	if (T.current->rows[T.c.y]->length<T.c.x)
-	//		T.current->rows[T.c.y]->length = T.c.x;
+	//	if (current_row(T.c.y)->length<T.c.x)
+	//		current_row(T.c.y)->length = T.c.x;
+}
+
+// == printing runs of chars ==
+// these have the same result as calling put_char() on each char, but they fill a whole line segment at a time:
+// the attributes are only computed once, and the wide char cleanup is only done at the ends of each segment,
+// since the chars in between all overwrite each other.
+
+// start a segment at the cursor (wrapping first, if a char of `width` doesn't fit)
+// returns the first cell
+static Cell* begin_span(int width) {
+	wrap_for(width);
+	Cell* dest = &current_row(T.c.y)->cells[T.c.x];
+	clean_wc_left(dest, T.c.x);
+	return dest;
+}
+
+// finish a segment which filled `cells` cells, where the last char was `last` cells from the start
+static void end_span(int cells, int last) {
+	Row* row = current_row(T.c.y);
+	touch_span(row, T.c.x, T.c.x+cells);
+	clean_wc_right(&row->cells[T.c.x+cells], T.c.x+cells);
+	T.last = true;
+	T.last_x = T.c.x+last;
+	T.last_y = T.c.y;
+	T.c.x += cells;
+}
+
+void put_chars(int len, const Char chars[len]) {
+	AttrId attr = print_attrs();
+	int i = 0;
+	while (i<len) {
+		Char c = translate_char(chars[i]);
+		int width = char_width(c);
+		if (width==0) {
+			add_combining_char(c);
+			i++;
+			continue;
+		}
+		Cell* dest = begin_span(width);
+		int space = T.width-T.c.x;
+		int x = 0;
+		int last;
+		// fill the line until we run out of chars or space, or find a combining char
+		while (1) {
+			dest[x] = (Cell){
+				.chr = c,
+				.wide = width==2,
+				.attr = attr,
+			};
+			if (width==2)
+				add_dummy(&dest[x]);
+			last = x;
+			x += width;
+			i++;
+			if (i>=len)
+				break;
+			c = translate_char(chars[i]);
+			width = char_width(c);
+			if (width==0 || x+width > space)
+				break;
+		}
+		end_span(x, last);
+	}
+}
+
+// print `c`, `count` times (for REP)
+void put_repeat(Char c, int count) {
+	c = translate_char(c);
+	int width = char_width(c);
+	if (width==0) {
+		FOR (i, count)
+			add_combining_char(c);
+		return;
+	}
+	Cell cell = {
+		.chr = c,
+		.wide = width==2,
+		.attr = print_attrs(),
+	};
+	while (count>0) {
+		Cell* dest = begin_span(width);
+		int n = (T.width-T.c.x)/width;
+		if (n > count)
+			n = count;
+		assert(n >= 1); // (begin_span() made room for at least one)
+		FOR (i, n) {
+			dest[i*width] = cell;
+			if (width==2)
+				add_dummy(&dest[i*width]);
+		}
+		end_span(n*width, (n-1)*width);
+		count -= n;
+	}
+}
+
+// print a run of printable ascii chars (0x20-0x7E)
+void put_ascii(int len, const utf8 text[len]) {
+	// the DEC graphics charset turns these into box drawing chars etc., so just use the normal path
+	if (T.charsets[0] == '0') {
+		FOR (i, len)
+			put_char(text[i]);
+		return;
+	}
+	
+	Cell cell = {.attr = print_attrs()};
+	while (len>0) {
+		Cell* dest = begin_span(1);
+		int n = T.width-T.c.x;
+		if (n > len)
+			n = len;
+		FOR (i, n) {
+			cell.chr = text[i];
+			dest[i] = cell;
+		}
+		end_span(n, n-1);
+		text += n;
+		len -= n;
+	}
 }
 
 void backspace(void) {
@@ -691,7 +1472,8 @@ void delete_chars(int n) {
 	n = limit(n, 0, T.width-T.c.x);
 	if (!n)
 		return;
-	Row* line = T.current->rows[T.c.y];
+	Row* line = current_row(T.c.y);
+	touch_cells(line, T.c.x, T.width);
 	memmove(&line->cells[T.c.x], &line->cells[T.c.x+n], sizeof(Cell)*(T.width-T.c.x-n));
 	clear_row(line, T.width-n, true);
 }
@@ -705,7 +1487,8 @@ void insert_blank(int n) {
 	int dst = T.c.x + n;
 	int src = T.c.x;
 	int size = T.width - dst;
-	Row* line = T.current->rows[T.c.y];
+	Row* line = current_row(T.c.y);
+	touch_cells(line, dst, T.width);
 	memmove(&line->cells[dst], &line->cells[src], size * sizeof(Cell));
 	clear_region(src, T.c.y, dst, T.c.y+1);
 }
@@ -801,12 +1584,14 @@ void set_scroll_region(int top, int bottom) {
 // 
 
 void set_scrollback(int pos) {
-	pos = limit(pos, 0, history.length);
+	pos = limit(pos, 0, history_length());
 	//print("scrolling %d\n", pos);
 	int dist = pos-T.scroll;
 	if (abs(dist)<T.height)
-		draw_rotate_rows(0, T.height, dist, true);
+		host.rotate_rows(0, T.height, dist, true);
 	T.scroll = pos;
+	if (pos==0 && dist)
+		history_free_cache();
 }
 
 bool move_scrollback(int amount) {
@@ -818,8 +1603,11 @@ bool move_scrollback(int amount) {
 // get a row from the current screen (if y ≥ 0) or the history buffer (if y < 0). returns NULL if n is out of range
 Row* get_row(int y) {
 	if (y>=0 && y<T.height)
-		return T.current->rows[y];
-	if (y<0 && -y <= history.length) // history is "-1 indexed"
-		return history.rows[(history.head+y+history.size) % history.size];
+		return current_row(y);
+	if (y<0) { // history is "-1 indexed"
+		reserve_attrs(T.width*2); // (unpacking a row can add attributes: the cells, plus the blank cells of each row it's made from)
+		reserve_clusters(T.width);
+		return history_row(-y);
+	}
 	return NULL;
 }
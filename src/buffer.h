@@ -33,7 +33,7 @@ typedef union Color {
 // display attributes for characters
 typedef struct Attrs {
 	Color color, background, underline_color;
-	uint16_t link; // hyperlink. 0 = none, 1…max = T.links.items[n-1]
+	uint16_t link; // hyperlink. 0 = none, 1…max = T.links.items[n-1] (see buffer.c)
 	
 	int8_t weight: 2; // 0 = normal, 1 = bold, -1 = faint
 	bool italic: 1;
@@ -47,18 +47,26 @@ typedef struct Attrs {
 	bool invisible: 1; // todo?
 } Attrs;
 
+// index into T.attr_table (see intern_attrs())
+typedef uint16_t AttrId;
+
 // single character cell
 typedef struct Cell {
 	Char chr;
-	Char combining[1]; //todo: (and make this like, 4 or something)
-	Attrs attrs;
+	Char combining; // 0 = none, a single combining char, or CLUSTER+n for several (see cell_combining())
+	AttrId attr; // (most screens only use a few different attributes, so they're stored in a table instead of in every cell)
 	int8_t wide: 2; //0 = normal, 1 = left half of wide char, -1 = right half (chr=0)
 // fullwidth chars consist of 2 cells:
 // - a cell with wide=1, and the character data stored in it
 // - a cell with wide=-1, and no data
 } Cell;
 
-// TODO: make a compressed version of this for storing history cells?
+// Cell.combining values above this refer to a sequence of combining chars in T.clusters
+#define CLUSTER 0x40000000
+// maximum number of combining chars in one cell (any more are ignored)
+#define CLUSTER_MAX 32
+
+// (rows in the history are stored in a more compact format: see history.c)
 
 typedef struct Row {
 	// TODO:
@@ -69,6 +77,8 @@ typedef struct Row {
 	// they are then re-wrapped, with the splits marked using the same flags.
 	//int length; // where newline
 	bool wrap, cont;
+	uint32_t generation; // changed whenever the cells are (see touch_row())
+	int damage_start, damage_end; // range of cells which changed since the renderer last drew this row
 	Cell cells[]; // allocated after struct
 } Row;
 
@@ -82,7 +92,8 @@ typedef struct Cursor {
 
 // the main or alternate buffer.
 typedef struct Buffer {
-	Row** rows;
+	Row** rows; // a ring of T.height rows: screen row y is rows[(base+y) % T.height] (use buffer_row())
+	int base; // (so scrolling the whole screen only has to change this)
 	Cursor saved_cursor; // it seems that each buffer has a separate *saved* cursor (while the *current* cursor position itself is shared)
 } Buffer;
 
@@ -123,16 +134,50 @@ typedef struct Term {
 	
 	int charsets[4];
 	
-	struct links {
-		int length;
-		utf8* items[32767];
-	} links;
-	
 	bool app_keypad, app_cursor;
 	bool bracketed_paste;
 	int mouse_mode;
 	int mouse_encoding;
 	bool report_focus; //todo
+	bool synchronized; // synchronized output (mode 2026): the app is in the middle of an update, so don't redraw yet
+	
+	uint32_t generation; // last value given to Row.generation
+	
+	// all the distinct attributes used by cells on the screen.
+	// when this fills up, the unused entries are removed (see buffer.c)
+	struct attr_table {
+		Attrs* items;
+		int length, size;
+		uint32_t* index; // hash table (with 2*size slots) of item numbers+1, 0 = empty
+		AttrId last; // the most recent one to be looked up
+	} attr_table;
+	
+	// sequences of combining chars, for cells that have more than one (see buffer.c)
+	// like the attribute table, unused entries are removed all at once when it fills up
+	struct cluster_table {
+		Char* items; // each entry is its length, followed by the chars. Cell.combining is CLUSTER + the position of the entry
+		int length, size; // (in Chars)
+		int count; // number of entries
+		uint32_t* index; // hash table (with 2*index_size slots) of positions+1, 0 = empty
+		int index_size;
+	} clusters;
+	
+	// hyperlinks (from OSC 8). entries are shared by all the cells with the same link, and freed when nothing uses them
+	struct link_table {
+		struct link {
+			utf8* id; // (the "id=" parameter, or "")
+			utf8* url; // (NULL if the slot is free)
+			int refs; // number of attribute table entries and history blocks which use it
+			int next; // next link in the same hash chain, or next free slot (0 = none)
+		}* items;
+		int length, size;
+		int free; // first free slot (0 = none)
+		int* index; // hash table (with index_size slots) of the first link in each chain, 0 = empty
+		int index_size;
+		int count; // number of links in use
+		int* unused; // links with no references, which might still be used by the cursor
+		int unused_length, unused_size;
+	} links;
 } Term;
 
 void init_term(int width, int height);
@@ -142,5 +187,46 @@ bool move_scrollback(int amount);
 void dirty_all(void);
 Row* get_row(int y);
 Row* resize_row(Row** row, int size, int old_size);
+void clear_row(Row* row, int start, bool bce);
+AttrId intern_attrs(Attrs attrs);
+Char intern_cluster(int length, const Char chars[length]);
+int cell_combining(const Cell* cell, const Char** chars);
+void ref_link(int link);
+void unref_link(int link);
+const utf8* link_url(int link);
 
 extern Term T;
+
+// get the slot for screen row `y` (0 … T.height-1) in a buffer
+static inline Row** buffer_row(Buffer* buf, int y) {
+	int i = buf->base+y;
+	if (i >= T.height)
+		i -= T.height;
+	return &buf->rows[i];
+}
+
+// call this after changing cells `x1`…`x2-1` of a row, so the renderer knows to redraw them
+// (the renderer remembers which row it drew, and its generation, so a row only needs to be touched when its contents change, not when it moves)
+static inline void touch_cells(Row* row, int x1, int x2) {
+	if (x1 < row->damage_start)
+		row->damage_start = x1;
+	if (x2 > row->damage_end)
+		row->damage_end = x2;
+	row->generation = ++T.generation;
+}
+
+// same, for the whole row (this also works on a row that was just allocated)
+static inline void touch_row(Row* row) {
+	row->damage_start = 0;
+	row->damage_end = T.width;
+	row->generation = ++T.generation;
+}
+
+// screen row `y` in the current buffer
+static inline Row* current_row(int y) {
+	return *buffer_row(T.current, y);
+}
+
+static inline const Attrs* cell_attrs(const Cell* cell) {
+	return &T.attr_table.items[cell->attr];
+}
@@ -22,6 +22,9 @@ void forward_tab(int n);
 
 // inserting/deleting
 void put_char(Char c);
+void put_chars(int len, const Char chars[len]);
+void put_repeat(Char c, int count);
+void put_ascii(int len, const utf8 text[len]);
 void delete_chars(int n);
 void insert_blank(int n);
 void delete_lines(int n);
@@ -41,5 +44,7 @@ void full_reset(void);
 
 void switch_buffer(bool alt);
 
-int new_link(utf8* url);
-void init_history(void);
+int intern_link(const utf8* id, const utf8* url);
+void reserve_attrs(int count);
+void reserve_clusters(int count);
+void reserve_links(int count);
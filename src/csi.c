@@ -1,10 +1,13 @@
 // Parsing control sequences starting with CSI (`ESC [`)
 
+#include <string.h>
+
 #include "common.h"
 #include "ctlseqs2.h"
-#include "tty.h"
+#include "host.h"
 #include "buffer.h"
 #include "buffer2.h"
+#include "history.h"
 
 // csi sequence:
 // CSI [private] [arguments...] char [char2]
@@ -22,15 +25,21 @@ static void dump(Char last) {
 				print("; ");
 		}
 	}
-	if (P.csi_char)
-		print("%s ", char_name(P.csi_char));
+	if (P.intermediate)
+		print("%s ", char_name(P.intermediate));
 	print("%s ", char_name(last));
 	print("\n");
 }
 
 static bool process_sgr_color(int* i, Color* out) {
-	int type = P.argv[*i+1];
-	// TODO: check to make sure there are enough args left
+	int type = *i+1<P.argc ? P.argv[*i+1] : -1;
+	int need = type==2 ? 4 : type==5 ? 2 : 1;
+	// (this also makes sure the result only depends on the sequence itself, which the SGR cache relies on)
+	if (*i+need >= P.argc) {
+		print("missing args for SGR color\n");
+		*i = P.argc-1;
+		return false;
+	}
 	switch (type) {
 	default:
 		print("unknown SGR color type: %d\n", type);
@@ -63,8 +72,16 @@ static bool process_sgr_color(int* i, Color* out) {
 	return false;
 }
 
+static void reset_sgr(Attrs* attrs) {
+	*attrs = (Attrs){
+		.color = {.i=-1},
+		.background = {.i=-2},
+		// rest are set to 0
+	};
+}
+
 // CSI [ ... m
-static void process_sgr(void) {
+static void process_sgr(Attrs* attrs) {
 	int c = P.argc;
 #define SEVEN(x) x: case x+1: case x+2: case x+3: case x+4: case x+5: case x+6: case x+7
 	for (int i=0; i<c; i++) {
@@ -74,101 +91,97 @@ static void process_sgr(void) {
 			print("unknown sgr: %d\n", a);
 			break;
 		case 0: // reset
-			T.c.attrs = (Attrs){
-				.color = {.i=-1},
-				.background = {.i=-2},
-				// rest are set to 0
-			};
+			reset_sgr(attrs);
 			break;
 		case 1: // bold
-			T.c.attrs.weight = 1;
+			attrs->weight = 1;
 			break;
 		case 2: // faint
-			T.c.attrs.weight = -1; //this should blend fg with bg color maybe. but no one uses faint anyway so whatever
+			attrs->weight = -1; //this should blend fg with bg color maybe. but no one uses faint anyway so whatever
 			break;
 		case 3: // italic
-			T.c.attrs.italic = true;
+			attrs->italic = true;
 			break;
 		case 4: // underline
 			if (P.arg_colon[i]) { // 4:<type>
 				i++;
 				int t = P.argv[i];
 				if (t>=0 && t<=5)
-					T.c.attrs.underline = t;
+					attrs->underline = t;
 			} else // normal
-				T.c.attrs.underline = 1;
+				attrs->underline = 1;
 			break;
 		case 5: //slow blink
 		case 6: //fast blink
 			// todo? Personally I have no interest in this since it's obnoxious and complicates rendering, but...
 			break;
 		case 7: // reverse colors
-			T.c.attrs.reverse = true;
+			attrs->reverse = true;
 			break;
 		case 8: // invisible (todo)
-			T.c.attrs.invisible = true;
+			attrs->invisible = true;
 			break;
 		case 9: // strikethrough
-			T.c.attrs.strikethrough = true;
+			attrs->strikethrough = true;
 			break;
 		// (10-20 are fonts)
 		case 21: // double underline
-			T.c.attrs.underline = 2;
+			attrs->underline = 2;
 			break;
 		case 22: // bold/faint OFF
-			T.c.attrs.weight = 0;
+			attrs->weight = 0;
 			break;
 		case 23: // italic OFF
-			T.c.attrs.italic = false;
+			attrs->italic = false;
 			break;
 		case 24: // underline OFF
-			T.c.attrs.underline = 0;
+			attrs->underline = 0;
 			break;
 		case 25: // blink OFF
 			break;
 		case 27: // reverse OFF
-			T.c.attrs.reverse = false;
+			attrs->reverse = false;
 			break;
 		case 28: // invisible OFF
-			T.c.attrs.invisible = false;
+			attrs->invisible = false;
 			break;
 		case 29: // strikethrough OFF
-			T.c.attrs.strikethrough = false;
+			attrs->strikethrough = false;
 			break;
 		case SEVEN(30): // set text color (0-7)
-			T.c.attrs.color = (Color){.i = a-30};
+			attrs->color = (Color){.i = a-30};
 			break;
 		case 38: // set text color
-			process_sgr_color(&i, &T.c.attrs.color);
+			process_sgr_color(&i, &attrs->color);
 			break;
 		case 39: // reset text color
-			T.c.attrs.color = (Color){.i = -1};
+			attrs->color = (Color){.i = -1};
 			break;
 		case SEVEN(40): // set background color (0-7)
-			T.c.attrs.background = (Color){.i = a-40};
+			attrs->background = (Color){.i = a-40};
 			break;
 		case 48: // set background color
-			process_sgr_color(&i, &T.c.attrs.background);
+			process_sgr_color(&i, &attrs->background);
 			break;
 		case 49: // reset background color
-			T.c.attrs.background = (Color){.i = -2};
+			attrs->background = (Color){.i = -2};
 			break;
 		// (50-55 are not widely used)
 		case 58: // set underline color
-			if (process_sgr_color(&i, &T.c.attrs.underline_color))
-				T.c.attrs.colored_underline = true;
+			if (process_sgr_color(&i, &attrs->underline_color))
+				attrs->colored_underline = true;
 			break;
 		case 59: // reset underline color (this means to match the text color I assume)
-			T.c.attrs.colored_underline = false;
-			T.c.attrs.underline_color = (Color){0}; // just zero this because why not
+			attrs->colored_underline = false;
+			attrs->underline_color = (Color){0}; // just zero this because why not
 			break;
 		// (60-75 not widely used)
 		// (76-89 unused)
 		case SEVEN(90): // set text color (8-15)
-			T.c.attrs.color = (Color){.i = a-90+8};
+			attrs->color = (Color){.i = a-90+8};
 			break;
 		case SEVEN(100): // set background color (8-15)
-			T.c.attrs.background = (Color){.i = a-100+8};
+			attrs->background = (Color){.i = a-100+8};
 			break;
 		}
 		if (P.arg_colon[i]) {
@@ -179,6 +192,144 @@ static void process_sgr(void) {
 	}
 }
 
+// == SGR fast path ==
+// colored output sends the same few SGR sequences over and over,
+// so complete `ESC [ ... m` sequences are handled here straight from the raw bytes, without going through the parser.
+// every SGR parameter either sets an attribute or leaves it alone, so the effect of a whole sequence
+// can be stored as a mask of bits to keep plus bits to set. these are cached by the parameter string.
+
+typedef struct SgrEffect {
+	uint8_t keep[sizeof(Attrs)];
+	uint8_t set[sizeof(Attrs)];
+} SgrEffect;
+
+typedef struct SgrCacheEntry {
+	uint8_t length; // 0 = empty
+	utf8 params[31];
+	SgrEffect effect;
+} SgrCacheEntry;
+
+static SgrCacheEntry sgr_cache[64];
+
+// read the arguments into P.argv the same way the parser does (see `do_action`)
+static void parse_sgr_args(int len, const utf8 params[len]) {
+	P.argc = 1;
+	P.argv[0] = 0;
+	P.arg_colon[0] = false;
+	P.csi_private = 0;
+	P.intermediate = 0;
+	FOR (i, len) {
+		if (params[i]==';' || params[i]==':') {
+			if (P.argc < LEN(P.argv)) {
+				P.arg_colon[P.argc-1] = params[i]==':';
+				P.argc++;
+			}
+			P.argv[P.argc-1] = 0;
+			P.arg_colon[P.argc-1] = false;
+		} else {
+			int* arg = &P.argv[P.argc-1];
+			if (*arg < 100000)
+				*arg = *arg*10 + params[i]-'0';
+		}
+	}
+}
+
+static void compute_sgr_effect(int len, const utf8 params[len], SgrEffect* out) {
+	parse_sgr_args(len, params);
+	// apply the sequence to all 0 bits and all 1 bits, to see which bits it changes
+	Attrs zeros, ones;
+	memset(&zeros, 0, sizeof(Attrs));
+	memset(&ones, 0xFF, sizeof(Attrs));
+	process_sgr(&zeros);
+	process_sgr(&ones);
+	uint8_t* z = (uint8_t*)&zeros;
+	uint8_t* o = (uint8_t*)&ones;
+	FOR (i, sizeof(Attrs)) {
+		out->keep[i] = z[i] ^ o[i];
+		out->set[i] = z[i];
+	}
+}
+
+static void apply_sgr_effect(const SgrEffect* e) {
+	uint8_t* a = (uint8_t*)&T.c.attrs;
+	FOR (i, sizeof(Attrs))
+		a[i] = a[i] & e->keep[i] | e->set[i];
+}
+
+// parse a color channel (0-255), followed by `sep`
+static int parse_channel(const utf8** str, const utf8* end, utf8 sep) {
+	const utf8* s = *str;
+	int n = 0;
+	while (s<end && *s>='0' && *s<='9' && s-*str<3)
+		n = n*10 + *s++ - '0';
+	if (s==*str || n>=256)
+		return -1;
+	if (sep) {
+		if (s>=end || *s!=sep)
+			return -1;
+		s++;
+	} else if (s!=end)
+		return -1;
+	*str = s;
+	return n;
+}
+
+// `38;2;<r>;<g>;<b>` or `48;2;<r>;<g>;<b>` (these are too varied to cache)
+static bool sgr_truecolor(int len, const utf8 params[len]) {
+	if (len<10 || params[0]!='3' && params[0]!='4' || memcmp(params+1, "8;2;", 4))
+		return false;
+	const utf8* s = params+5;
+	const utf8* end = params+len;
+	int r = parse_channel(&s, end, ';');
+	if (r<0)
+		return false;
+	int g = parse_channel(&s, end, ';');
+	if (g<0)
+		return false;
+	int b = parse_channel(&s, end, 0);
+	if (b<0)
+		return false;
+	Color c = {
+		.truecolor = true,
+		.rgb = {r, g, b},
+	};
+	if (params[0]=='3')
+		T.c.attrs.color = c;
+	else
+		T.c.attrs.background = c;
+	return true;
+}
+
+// handle an SGR sequence at the start of `cs` (which starts with ESC)
+// returns the number of bytes used, or 0 if it isn't a complete SGR sequence, and should go through the parser instead
+int process_sgr_sequence(int len, const utf8 cs[len]) {
+	if (len<3 || cs[1]!='[')
+		return 0;
+	int n = 2;
+	while (n<len && n<2+LEN(sgr_cache[0].params) && (cs[n]>='0' && cs[n]<='9' || cs[n]==';' || cs[n]==':'))
+		n++;
+	if (n>=len || cs[n]!='m')
+		return 0;
+	const utf8* params = &cs[2];
+	int plen = n-2;
+	
+	if (plen==0 || plen==1 && params[0]=='0') {
+		reset_sgr(&T.c.attrs);
+	} else if (!sgr_truecolor(plen, params)) {
+		uint32_t hash = 2166136261;
+		FOR (i, plen)
+			hash = (hash ^ (uint8_t)params[i]) * 16777619;
+		SgrCacheEntry* e = &sgr_cache[hash % LEN(sgr_cache)];
+		if (e->length!=plen || memcmp(e->params, params, plen)) {
+			e->length = plen;
+			memcpy(e->params, params, plen);
+			compute_sgr_effect(plen, params, &e->effect);
+		}
+		apply_sgr_effect(&e->effect);
+	}
+	return n+1;
+}
+
 static void set_modes(bool state) {
 	for (int i=0; i<P.argc; i++) {
 		int a = P.argv[i];
@@ -244,9 +395,46 @@ static void set_private_mode(int mode, bool state) {
 	case 2004: // set bracketed paste mode
 		T.bracketed_paste = state;
 		break;
+	case 2026: // synchronized output (begin/end update)
+		T.synchronized = state;
+		break;
 	}
 }
 
+// for DECRQM: 0 = unknown mode, 1 = set, 2 = reset
+static int get_private_mode(int mode) {
+#define STATUS(x) ((x) ? 1 : 2)
+	switch (mode) {
+	default:
+		return 0;
+	case 1:
+		return STATUS(T.app_cursor);
+	case 12:
+		return STATUS(T.cursor_blink);
+	case 25:
+		return STATUS(T.show_cursor);
+	case 9:
+	case 1000:
+	case 1002:
+	case 1003:
+		return STATUS(T.mouse_mode==mode);
+	case 1004:
+		return STATUS(T.report_focus);
+	case 1005:
+	case 1006:
+	case 1015:
+		return STATUS(T.mouse_encoding==mode);
+	case 1047:
+	case 1049:
+		return STATUS(T.current==&T.buffers[1]);
+	case 2004:
+		return STATUS(T.bracketed_paste);
+	case 2026:
+		return STATUS(T.synchronized);
+	}
+#undef STATUS
+}
+
 // get the `n`th argument
 // if there aren't enough arguments, or the argument has a value of 0,
 // return `def` instead
@@ -261,13 +449,41 @@ static int arg01(void) {
 	return P.argv[0] ? P.argv[0] : 1;
 }
 
-void process_csi_command_2(Char c) {
+// commands with an intermediate char
+static void process_csi_command_2(Char c) {
 	switch (P.csi_private) {
 	default:
 		dump(c);
 		break;
+	case '?':
+		switch (P.intermediate) {
+		case '$':
+			switch (c) {
+			case 'p': // request private mode (DECRQM)
+				host_printf("\x1B[?%d;%d$y", P.argv[0], get_private_mode(P.argv[0]));
+				break;
+			default:
+				dump(c);
+				break;
+			}
+			break;
+		default:
+			dump(c);
+			break;
+		}
+		break;
 	case 0:
-		switch (P.csi_char) {
+		switch (P.intermediate) {
+		case '$':
+			switch (c) {
+			case 'p': // request mode (DECRQM) (none of the ANSI modes are supported)
+				host_printf("\x1B[%d;0$y", P.argv[0]);
+				break;
+			default:
+				dump(c);
+				break;
+			}
+			break;
 		case ' ':
 			switch (c) {
 			case 'q':
@@ -284,10 +500,14 @@ void process_csi_command_2(Char c) {
 		}
 		break;
 	}
-	P.state = NORMAL;
 }
 
-static void process_csi_command(Char c) {
+void process_csi_command(Char c) {
+	if (P.intermediate) {
+		process_csi_command_2(c);
+		return;
+	}
+	
 	int arg = P.argv[0]; //will be 0 if no args were passed. this is intentional.
 	
 	switch (P.csi_private) {
@@ -411,14 +631,14 @@ static void process_csi_command(Char c) {
 			delete_lines(arg01());
 			break;
 		case 'm': // set graphics modes =blink= =bold= =dim= =invis= =memu= =op= =rev= =ritm= =rmso= =rmul= =setab= =setaf= =sgr= =sgr0= =sitm= =smso= =smul= =rmxx= =setb24= =setf24= =smxx=
-			process_sgr();
+			process_sgr(&T.c.attrs);
 			break;
 		case 'n':
 			switch (arg) {
 			default:
 				goto invalid;
 			case 6:
-				tty_printf("\x1B[%d;%dR", T.c.y+1, T.c.x+1);
+				host_printf("\x1B[%d;%dR", T.c.y+1, T.c.x+1);
 			}
 			break;
 		case 'P': // delete characters =dch= =dch1=
@@ -445,41 +665,13 @@ static void process_csi_command(Char c) {
 			back_tab(arg01());
 			break;
 		case 'b': // repeat previous char
-			if (P.last_printed >= 0) {
-				int count = arg01();
-				for (int i=0; i<count; i++)
-					put_char(P.last_printed);
-			}
+			if (P.last_printed >= 0)
+				put_repeat(P.last_printed, arg01());
 			break;
-		case ' ': case '$': case '#': case '"':
-			P.csi_char = c;
-			P.state = CSI_2;
-			return;
 		}
 	}
-	P.state = NORMAL;
 	return;
  invalid:
 	print("unknown command args: ");
 	dump(c);
-	P.state = NORMAL;
-}
-
-void process_csi_char(Char c) {
-	if (c>='0' && c<='9') { // arg
-		P.argv[P.argc-1] *= 10;
-		P.argv[P.argc-1] += c - '0';
-	} else if (c==':' || c==';') { // arg separator
-		// the purpose of the colons is to allow for argument grouping.
-		// because all the other codes are a single number, so if they are not supported, it's nbd
-		// but multi-number codes can cause frame shift issues, if they aren't supported, then the terminal will interpret the later values as individual args which is wrong.
-		// so the colons allow you to know how many values to skip in this case
-		P.arg_colon[P.argc-1] = c==':';
-		P.argc++;
-		P.argv[P.argc-1] = 0;
-	} else {
-		// finished
-		P.arg_colon[P.argc-1] = false;
-		process_csi_command(c);
-	}
 }
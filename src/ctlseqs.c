@@ -2,19 +2,18 @@
 #define _XOPEN_SOURCE 500
 #include <stdio.h>
 #include <string.h>
+#ifdef __SSE2__
+ #include <emmintrin.h>
+#endif
 
 #include "common.h"
 #include "ctlseqs.h"
 #include "ctlseqs2.h"
-#include "tty.h"
+#include "utf8.h"
 #include "buffer.h"
 #include "buffer2.h"
-#include "draw2.h"
 #include "settings.h"
-// messy
-extern void own_clipboard(utf8* which, utf8* string);
-extern void set_title(utf8* c);
-extern void change_font(const utf8* name);
+#include "host.h"
 
 ParseState P;
 
@@ -44,52 +43,25 @@ bool process_control_char(utf8 c) {
 	return true;
 }
 
-static void begin_string(int type) {
-	P.state = STRING;
-	P.string_size = 1030;
-	ALLOC(P.string, P.string_size);
-	P.string_command = type;
-	P.string_length = 0;
-}
-
-// xterm's VTPrsTbl.c is an interesting idea
-// ex: in the normal state, it looks up each char in `ansi_table`.
-// if it reads ESC, it would look up `ansi_table["\e"]` and switch to that state, which is CASE_ESC
-// then, in that state, it uses `esc_table` to decide how to handle the next char, etc
-
 static void process_escape_char(Char c) {
-	switch (c) {
-		// multi-char sequences
+	switch (P.intermediate) {
+	default:
+		print("unknown control sequence: ESC %s %s\n", char_name(P.intermediate), char_name(c));
+		return;
 	case '(': // designate G0-G3 char sets
 	case ')':
 	case '*':
 	case '+':
-		P.state = ALTCHARSET;
-		P.charset = c-'(';
-		return;
-	case '[': // CSI
-		P.argc = 1;
-		P.argv[0] = 0;
-		P.csi_private = 0;
-		P.csi_char = 0;
-		P.state = CSI_START;
-		return;
-		
-	// things that take string parameters
-	case 'P': // Device Control String
-		begin_string(DCS);
-		return;
-	case ']': // Operating System Command
-		begin_string(OSC);
-		return;
-	case '^': // Privacy Message
-		begin_string(PM);
-		return;
-	case '_': // Application Program Command
-		begin_string(APC);
+		if (c=='0' || c=='B')
+			select_charset(P.intermediate-'(', c);
+		else
+			print("unknown charset: %s\n", char_name(c));
 		return;
-		
-	// single char sequences
+	case 0:
+		break;
+	}
+	
+	switch (c) {
 	case '7': // Save Cursor
 		save_cursor();
 		break;
@@ -112,65 +84,81 @@ static void process_escape_char(Char c) {
 	case 'c': // full reset
 		full_reset();
 		break;
+	case '\\': // String Terminator (the string was already ended by the ESC)
+		break;
 		
 	default:
 		print("unknown control sequence: ESC %s\n", char_name(c));
 	}
-	P.state = NORMAL;
 }
 
-static void process_kitty(int args[128], int length, utf8 data[length]) {
-	print("got kitty data\n");
-}
+// APC G (kitty graphics)
+static struct {
+	int args[128];
+	int length;
+} kitty;
 
-static void process_apc(void) {
-	utf8* s = P.string;
-	if (s[0]=='G') { // kitty graphics
-		s++;
-		int args[128] = {
-			['a'] = 't',
-			['f'] = 32,
-			['t'] = 'd',
-		};
-		utf8 key;
-		utf8* valueStart;
-		
-		while (1) {
-			if (*s==';') {// end of key=value parameters
-				s++;
-				break;
-			}
-			if (*s>='a'&&*s<='z' || *s>='A'&&*s<='Z') { // key name
-				key = *s;
+// parse the key=value parameters at the start of a kitty graphics command
+// returns a pointer to the payload, or NULL if invalid
+static utf8* parse_kitty_header(utf8* s) {
+	memset(kitty.args, 0, sizeof(kitty.args));
+	kitty.args['a'] = 't';
+	kitty.args['f'] = 32;
+	kitty.args['t'] = 'd';
+	kitty.length = 0;
+	utf8 key;
+	utf8* valueStart;
+	
+	while (1) {
+		if (*s==';') // end of key=value parameters
+			return s+1;
+		if (*s=='\0') // no payload
+			return s;
+		if (*s>='a'&&*s<='z' || *s>='A'&&*s<='Z') { // key name
+			key = *s;
+			s++;
+			if (*s=='=') { // =
 				s++;
-				if (*s=='=') { // =
+				valueStart = s;
+				while (*s!=',' && *s!=';' && *s!='\0')
 					s++;
-					valueStart = s;
-					while (*s!=',' && *s!=';')
-						s++;
-					// now we have the value
-					if (*valueStart=='-' || *valueStart>='0'&&*valueStart<='9') {
-						args[key] = atoi(valueStart); //number
-					} else {
-						args[key] = *valueStart; // just 1 char
-					}
-					if (*s==',')
-						s++;
-					else if (*s!=';') {
-						print("invalid char after value in kitty seq\n");
-						return; // error, invalid character after value
-					}
+				// now we have the value
+				if (*valueStart=='-' || *valueStart>='0'&&*valueStart<='9') {
+					kitty.args[key] = atoi(valueStart); //number
 				} else {
-					print("missing = after key name '%c' in kitty seq\n", key);
-					return; // error, missing = after key name
+					kitty.args[key] = *valueStart; // just 1 char
+				}
+				if (*s==',')
+					s++;
+				else if (*s!=';' && *s!='\0') {
+					print("invalid char after value in kitty seq\n");
+					return NULL; // error, invalid character after value
 				}
 			} else {
-				print("invalid char in kitty seq\n");
-				return;
-				// idk invalid character
+				print("missing = after key name '%c' in kitty seq\n", key);
+				return NULL; // error, missing = after key name
 			}
+		} else {
+			print("invalid char in kitty seq\n");
+			return NULL;
+			// idk invalid character
 		}
-		process_kitty(args, P.string_length-(s-P.string), s);
+	}
+}
+
+static void kitty_stream(int len, utf8 data[len], bool end) {
+	kitty.length += len;
+	if (end)
+		print("got kitty data (%d bytes)\n", kitty.length);
+}
+
+// (only for APC strings which weren't streamed)
+static void process_apc(void) {
+	utf8* s = P.string;
+	if (s[0]=='G') { // kitty graphics
+		s = parse_kitty_header(s+1);
+		if (s)
+			kitty_stream(P.string_length-(s-P.string), s, true);
 	} else {
 		print("unknown APC command (yes i know the C already stands for command shhh)\n");
 	}
@@ -193,34 +181,35 @@ static int parse_number(utf8** str) {
 	//return -1; // fail: found char other than ; or end of string
 }
 
-static utf8* base64_decode(int len, utf8 input[len]) {
+// base64 is decoded incrementally, so it can be streamed
+typedef struct Base64Decoder {
+	int buffer;
+	int bits;
+} Base64Decoder;
+
+// returns the number of bytes written to `out` (at most len*6/8+1)
+static int base64_decode(Base64Decoder* d, int len, const utf8 input[len], utf8 out[]) {
 	static const int8_t base64_map[256] = {
-		['='] = 0,
+		['='] = -1,
 		['A'] = 0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19,20,21,22,23,24,25,
 		['a'] = 26,27,28,29,30,31,32,33,34,35,36,37,38,39,40,41,42,43,44,45,46,47,48,49,50,51,
 		['0'] = 52,53,54,55,56,57,58,59,60,61,
 		['+'] = 62, ['-'] = 62,
-		['/'] = 62, ['_'] = 63,
+		['/'] = 63, ['_'] = 63,
 	};
-	utf8* out;
-	ALLOC(out, (len*6+7)/8+1);
 	utf8* p = out;
-	int buffer = 0;
-	int bits = 0;
 	for (int i=0; i<len; i++) {
-		buffer <<= 6;
-		buffer |= base64_map[input[i]];
-		bits += 6;
-		if (bits >= 8) {
-			*p++ = buffer>>bits-8 & 0xFF;
-			bits -= 8;
+		int x = base64_map[(unsigned char)input[i]];
+		if (x<0) // padding
+			continue;
+		d->buffer = d->buffer<<6 | x;
+		d->bits += 6;
+		if (d->bits >= 8) {
+			d->bits -= 8;
+			*p++ = d->buffer>>d->bits & 0xFF;
 		}
 	}
-	if (bits) {
-		// todo
-	}
-	*p = '\0';
-	return out;
+	return p-out;
 }
 
 static void process_osc(void) {
@@ -237,9 +226,9 @@ static void process_osc(void) {
 	case 0: // set window title + icon title
 		if (*s==';') {
 			s++;
-			set_title(s);
+			host.set_title(s);
 		} else
-			set_title(NULL);
+			host.set_title(NULL);
 		break;
 	case 4: // change palette color
 		while (s && *s==';') {
@@ -251,33 +240,41 @@ static void process_osc(void) {
 				goto invalid;
 			s++;
 			utf8* se = strchr(s, ';');
-			parse_x_color(s, &T.palette[id]);
-			dirty_all();
+			host.parse_color(s, &T.palette[id]);
+			host.dirty_all();
 			s = se;
 		}
 		break;
 	case 8: // set hyperlink
-		// skip past params for now
+		// OSC 8 ; params ; url
+		// params are key=value pairs separated by :, and the only one that's used is id
 		if (*s!=';') {
 			print("invalid OSC 8 hyperlink\n");
 			break;
 		}
 		s++;
-		s = strchr(s, ';');
-		if (!s) {
+		utf8* url = strchr(s, ';');
+		if (!url) {
 			print("invalid OSC 8 hyperlink\n");
 			break;
 		}
-		s++;
-		if (*s == '\0') {
+		*url++ = '\0';
+		const utf8* id = "";
+		for (utf8* param=s; param; ) {
+			utf8* next = strchr(param, ':');
+			if (next)
+				*next++ = '\0';
+			if (!strncmp(param, "id=", 3))
+				id = param+3;
+			param = next;
+		}
+		if (*url == '\0') {
 			// reset (empty string)
 			T.c.attrs.link = 0;
 		} else {
 			// set url
-			print("hyperlink: %s\n", s);
-			int n = new_link(s);
-			if (n>=0)
-				T.c.attrs.link = n+1;
+			print("hyperlink: %s\n", url);
+			T.c.attrs.link = intern_link(id, url);
 		}
 		break;
 	case 10: // set foreground, background, cursor colors
@@ -286,29 +283,22 @@ static void process_osc(void) {
 		// what ??  i dont think this was written correctly..
 		/*while (s && *s==';') {
 			s++;
-			parse_x_color(s, (RGBColor*[]){
+			host.parse_color(s, (RGBColor*[]){
 				&T.foreground, &T.background, &T.cursor_color
 			}[p-10]);
 			p++;
 		}
-		dirty_all();*/
+		host.dirty_all();*/
 		break;
 	case 50: // change font
 		if (*s==';') {
 			s++;
-			change_font(s);
+			host.change_font(s);
 		}
 		break;
-	case 52:; // set clipboard
-		if (*s==';')
-			s++;
-		utf8* se = strchr(s, ';');
-		if (se) {
-			*se = '\0';
-			se++;
-			int len = strlen(se);
-			own_clipboard(s, base64_decode(len, se));
-		}
+	case 52: // set clipboard
+		// (this is streamed, see `string_header`. if we got here, the header was incomplete)
+		print("invalid OSC 52 clipboard\n");
 		break;
 	case 104:; // reset palette color
 		// untested
@@ -324,7 +314,7 @@ static void process_osc(void) {
 				T.palette[id] = settings.palette[id];
 			}
 		}
-		dirty_all();
+		host.dirty_all();
 		break;
 	case 110:; // reset fg color
 		T.foreground = settings.foreground;
@@ -341,166 +331,567 @@ static void process_osc(void) {
 	print("Invalid OSC command: %s\n", P.string);
 }
 
-static void end_string(void) {
-	P.state = NORMAL;
-	if (!P.string)
-		return;
-	P.string[P.string_length] = '\0';
+static void process_dcs(void) {
+	print("unknown DCS command: %s\n", char_name(P.dcs_final));
+}
+
+// == strings ==
+// the contents of OSC, DCS, and APC strings are collected in P.string.
+// this buffer is reused between strings and grows by doubling, so normally nothing needs to be allocated.
+// once the header of a string has arrived, `string_header` may choose a stream handler for it,
+// which is then given the payload in chunks as it arrives, rather than buffering the whole thing
+
+#define STRING_CHUNK 4096 // how much payload to collect before passing it to the stream handler
+#define STRING_MAX 1000000 // max length of strings which aren't streamed
+#define STRING_KEEP 65536 // if the buffer grew past this, free it once the string ends
+#define STRING_HEADER_MAX 256 // stop looking for a header after this many bytes
+
+static void begin_string(int type) {
+	P.string_command = type;
+	P.string_length = 0;
+	P.string_stream = NULL;
+	if (!P.string) {
+		P.string_size = 1024;
+		ALLOC(P.string, P.string_size);
+	}
+	P.string[0] = '\0';
+}
+
+// set the stream handler, and discard everything before the payload
+static void begin_stream(utf8* payload, void (*stream)(int len, utf8 data[len], bool end)) {
+	P.string_stream = stream;
+	P.string_length -= payload-P.string;
+	memmove(P.string, payload, P.string_length+1);
+}
+
+static void ignore_stream(int len, utf8 data[len], bool end) {
+}
+
+// OSC 52 (set clipboard)
+static struct {
+	utf8 which[16];
+	Base64Decoder decoder;
+	utf8* data;
+	int length;
+	int size;
+} clipboard;
+
+static void osc52_stream(int len, utf8 data[len], bool end) {
+	int need = clipboard.length + len*6/8+2;
+	if (need > clipboard.size) {
+		clipboard.size = need*2;
+		REALLOC(clipboard.data, clipboard.size);
+	}
+	clipboard.length += base64_decode(&clipboard.decoder, len, data, clipboard.data+clipboard.length);
+	if (end) {
+		clipboard.data[clipboard.length] = '\0';
+		host.set_clipboard(clipboard.which, clipboard.data); // (takes ownership)
+		clipboard.data = NULL;
+		clipboard.size = 0;
+	}
+}
+
+// check whether the start of the string selects a stream handler
+static void string_header(void) {
+	utf8* s = P.string;
 	switch (P.string_command) {
 	default:
-		print("unknown string command\n");
 		break;
 	case OSC:
-		process_osc();
+		if (parse_number(&s)==52 && *s==';') {
+			s++;
+			utf8* se = strchr(s, ';');
+			if (!se)
+				break;
+			snprintf(clipboard.which, sizeof(clipboard.which), "%.*s", (int)(se-s), s);
+			clipboard.decoder = (Base64Decoder){0};
+			clipboard.length = 0;
+			begin_stream(se+1, osc52_stream);
+		}
 		break;
 	case APC:
-		process_apc();
+		if (s[0]=='G') {
+			utf8* payload = parse_kitty_header(s+1);
+			if (payload)
+				begin_stream(payload, kitty_stream);
+			else
+				begin_stream(P.string+P.string_length, ignore_stream);
+		}
 		break;
 	}
-	FREE(P.string);
-	P.string_size = 0;
 }
 
-static void push_string_byte(utf8 c) {
-	if (!P.string)
-		return;
-	if (P.string_length >= P.string_size-1) {
-		if (P.string_size >= 100000) {
-			FREE(P.string);
-			return;
+static void end_string(void) {
+	if (P.string_length < 0) {
+		print("string too long\n");
+	} else if (P.string_stream) {
+		P.string_stream(P.string_length, P.string, true);
+	} else {
+		switch (P.string_command) {
+		default:
+			print("unknown string command\n");
+			break;
+		case SOS:
+		case PM:
+			break;
+		case OSC:
+			process_osc();
+			break;
+		case APC:
+			process_apc();
+			break;
+		case DCS:
+			process_dcs();
+			break;
 		}
-		P.string_size += 1024;
-		REALLOC(P.string, P.string_size);
 	}
-	P.string[P.string_length++] = c;
+	if (P.string_size > STRING_KEEP) {
+		FREE(P.string);
+		P.string_size = 0;
+	}
 }
 
-static void process_char(Char c) {
-	if (c<256 && c>=0 && process_control_char(c))
+static void push_string_bytes(int len, const utf8 data[len]) {
+	// the contents of SOS and PM are ignored, so we don't bother storing them
+	if (P.string_command==SOS || P.string_command==PM || P.string_length<0)
 		return;
-	////////////////////////
-	switch (P.state) {
-		 //normal
-	case NORMAL:
-		switch (c) {
-		case '\x1B':
-			P.state = ESC;
-			break;
-		default:
-			P.last_printed = c; //todo: when to reset this?
-			put_char(c);
+	if (!P.string_stream && P.string_length+len >= STRING_MAX) {
+		P.string_length = -1;
+		return;
+	}
+	if (P.string_length+len >= P.string_size) {
+		while (P.string_length+len >= P.string_size)
+			P.string_size *= 2;
+		REALLOC(P.string, P.string_size);
+	}
+	memcpy(P.string+P.string_length, data, len);
+	P.string_length += len;
+	P.string[P.string_length] = '\0';
+	
+	if (!P.string_stream && P.string_length-len < STRING_HEADER_MAX && memchr(data, ';', len))
+		string_header();
+	if (P.string_stream && P.string_length >= STRING_CHUNK) {
+		P.string_stream(P.string_length, P.string, false);
+		P.string_length = 0;
+	}
+}
+
+// == parser state machine ==
+// this is based on the DEC ANSI parser (https://vt100.net/emu/dec_ansi_parser), which is also what xterm's VTPrsTbl.c does
+// each char is sorted into a class, and then `TRANSITIONS[state][class]` gives the action to perform and the next state.
+// when the state changes, the exit action of the old state and the entry action of the new state are done as well
+
+enum char_class {
+	CC_C0, // C0 control chars (other than the ones below)
+	CC_BEL, // BEL (ends strings)
+	CC_LF, // LF (ends strings)
+	CC_CANCEL, // CAN, SUB (cancel the current sequence)
+	CC_ESC,
+	CC_INTER, // intermediate chars 0x20-0x2F
+	CC_DIGIT,
+	CC_COLON,
+	CC_SEMI,
+	CC_PRIVATE, // private markers `<=>?`
+	CC_FINAL, // 0x40-0x7E (other than the ones below)
+	CC_CSI, // `[`
+	CC_OSC, // `]`
+	CC_DCS, // `P`
+	CC_SOS, // `X^_` (SOS, PM, APC)
+	CC_DEL,
+	CC_C1, // raw bytes 0x80-0x9F (only possible in string states), or U+80-U+9F
+	CC_HIGH, // everything else
+	
+	CHAR_CLASSES,
+};
+
+enum parse_action {
+	IGNORE,
+	PRINT,
+	EXECUTE,
+	CLEAR,
+	COLLECT,
+	MARKER,
+	PARAM,
+	SEPARATOR,
+	ESC_DISPATCH,
+	CSI_DISPATCH,
+	HOOK,
+	PUT,
+	STRING_BEGIN,
+	STRING_END,
+};
+
+// the action and state are packed into one byte
+#define TO(state, action) ((action)<<4 | (state))
+_Static_assert(PARSE_STATES <= 16, "parse states must fit in 4 bits");
+
+#define R8(x) x,x,x,x,x,x,x,x
+static const uint8_t CHAR_CLASS[256] = {
+	// 0x00-0x1F
+	CC_C0, CC_C0, CC_C0, CC_C0, CC_C0, CC_C0, CC_C0, CC_BEL,
+	CC_C0, CC_C0, CC_LF, CC_C0, CC_C0, CC_C0, CC_C0, CC_C0,
+	CC_C0, CC_C0, CC_C0, CC_C0, CC_C0, CC_C0, CC_C0, CC_C0,
+	CC_CANCEL, CC_C0, CC_CANCEL, CC_ESC, CC_C0, CC_C0, CC_C0, CC_C0,
+	// 0x20-0x3F
+	R8(CC_INTER), R8(CC_INTER),
+	R8(CC_DIGIT),
+	CC_DIGIT, CC_DIGIT, CC_COLON, CC_SEMI, CC_PRIVATE, CC_PRIVATE, CC_PRIVATE, CC_PRIVATE,
+	// 0x40-0x7F
+	R8(CC_FINAL), R8(CC_FINAL),
+	CC_DCS, CC_FINAL, CC_FINAL, CC_FINAL, CC_FINAL, CC_FINAL, CC_FINAL, CC_FINAL,
+	CC_SOS, CC_FINAL, CC_FINAL, CC_CSI, CC_FINAL, CC_OSC, CC_SOS, CC_SOS,
+	R8(CC_FINAL), R8(CC_FINAL), R8(CC_FINAL),
+	CC_FINAL, CC_FINAL, CC_FINAL, CC_FINAL, CC_FINAL, CC_FINAL, CC_FINAL, CC_DEL,
+	// 0x80-0x9F
+	R8(CC_C1), R8(CC_C1), R8(CC_C1), R8(CC_C1),
+	// 0xA0-0xFF
+	R8(CC_HIGH), R8(CC_HIGH), R8(CC_HIGH), R8(CC_HIGH),
+	R8(CC_HIGH), R8(CC_HIGH), R8(CC_HIGH), R8(CC_HIGH),
+	R8(CC_HIGH), R8(CC_HIGH), R8(CC_HIGH), R8(CC_HIGH),
+};
+#undef R8
+
+// transitions which are the same in most states
+#define ANYWHERE \
+	[CC_CANCEL] = TO(GROUND, EXECUTE), \
+	[CC_ESC] = TO(ESCAPE, IGNORE)
+
+static const uint8_t TRANSITIONS[PARSE_STATES][CHAR_CLASSES] = {
+	[GROUND] = {
+		[CC_C0] = TO(GROUND, EXECUTE), [CC_BEL] = TO(GROUND, EXECUTE), [CC_LF] = TO(GROUND, EXECUTE),
+		ANYWHERE,
+		[CC_INTER] = TO(GROUND, PRINT), [CC_DIGIT] = TO(GROUND, PRINT), [CC_COLON] = TO(GROUND, PRINT),
+		[CC_SEMI] = TO(GROUND, PRINT), [CC_PRIVATE] = TO(GROUND, PRINT), [CC_FINAL] = TO(GROUND, PRINT),
+		[CC_CSI] = TO(GROUND, PRINT), [CC_OSC] = TO(GROUND, PRINT), [CC_DCS] = TO(GROUND, PRINT),
+		[CC_SOS] = TO(GROUND, PRINT),
+		[CC_DEL] = TO(GROUND, IGNORE), [CC_C1] = TO(GROUND, IGNORE), [CC_HIGH] = TO(GROUND, PRINT),
+	},
+	[ESCAPE] = {
+		[CC_C0] = TO(ESCAPE, EXECUTE), [CC_BEL] = TO(ESCAPE, EXECUTE), [CC_LF] = TO(ESCAPE, EXECUTE),
+		ANYWHERE,
+		[CC_INTER] = TO(ESCAPE_INTERMEDIATE, COLLECT), [CC_DIGIT] = TO(GROUND, ESC_DISPATCH), [CC_COLON] = TO(GROUND, ESC_DISPATCH),
+		[CC_SEMI] = TO(GROUND, ESC_DISPATCH), [CC_PRIVATE] = TO(GROUND, ESC_DISPATCH), [CC_FINAL] = TO(GROUND, ESC_DISPATCH),
+		[CC_CSI] = TO(CSI_ENTRY, IGNORE), [CC_OSC] = TO(STRING, IGNORE), [CC_DCS] = TO(DCS_ENTRY, IGNORE),
+		[CC_SOS] = TO(STRING, IGNORE),
+		[CC_DEL] = TO(ESCAPE, IGNORE), [CC_C1] = TO(GROUND, ESC_DISPATCH), [CC_HIGH] = TO(GROUND, ESC_DISPATCH),
+	},
+	[ESCAPE_INTERMEDIATE] = {
+		[CC_C0] = TO(ESCAPE_INTERMEDIATE, EXECUTE), [CC_BEL] = TO(ESCAPE_INTERMEDIATE, EXECUTE), [CC_LF] = TO(ESCAPE_INTERMEDIATE, EXECUTE),
+		ANYWHERE,
+		[CC_INTER] = TO(ESCAPE_INTERMEDIATE, COLLECT), [CC_DIGIT] = TO(GROUND, ESC_DISPATCH), [CC_COLON] = TO(GROUND, ESC_DISPATCH),
+		[CC_SEMI] = TO(GROUND, ESC_DISPATCH), [CC_PRIVATE] = TO(GROUND, ESC_DISPATCH), [CC_FINAL] = TO(GROUND, ESC_DISPATCH),
+		[CC_CSI] = TO(GROUND, ESC_DISPATCH), [CC_OSC] = TO(GROUND, ESC_DISPATCH), [CC_DCS] = TO(GROUND, ESC_DISPATCH),
+		[CC_SOS] = TO(GROUND, ESC_DISPATCH),
+		[CC_DEL] = TO(ESCAPE_INTERMEDIATE, IGNORE), [CC_C1] = TO(GROUND, ESC_DISPATCH), [CC_HIGH] = TO(GROUND, ESC_DISPATCH),
+	},
+	[CSI_ENTRY] = {
+		[CC_C0] = TO(CSI_ENTRY, EXECUTE), [CC_BEL] = TO(CSI_ENTRY, EXECUTE), [CC_LF] = TO(CSI_ENTRY, EXECUTE),
+		ANYWHERE,
+		[CC_INTER] = TO(CSI_INTERMEDIATE, COLLECT), [CC_DIGIT] = TO(CSI_PARAM, PARAM), [CC_COLON] = TO(CSI_PARAM, SEPARATOR),
+		[CC_SEMI] = TO(CSI_PARAM, SEPARATOR), [CC_PRIVATE] = TO(CSI_PARAM, MARKER), [CC_FINAL] = TO(GROUND, CSI_DISPATCH),
+		[CC_CSI] = TO(GROUND, CSI_DISPATCH), [CC_OSC] = TO(GROUND, CSI_DISPATCH), [CC_DCS] = TO(GROUND, CSI_DISPATCH),
+		[CC_SOS] = TO(GROUND, CSI_DISPATCH),
+		[CC_DEL] = TO(CSI_ENTRY, IGNORE), [CC_C1] = TO(CSI_IGNORE, IGNORE), [CC_HIGH] = TO(CSI_IGNORE, IGNORE),
+	},
+	[CSI_PARAM] = {
+		[CC_C0] = TO(CSI_PARAM, EXECUTE), [CC_BEL] = TO(CSI_PARAM, EXECUTE), [CC_LF] = TO(CSI_PARAM, EXECUTE),
+		ANYWHERE,
+		[CC_INTER] = TO(CSI_INTERMEDIATE, COLLECT), [CC_DIGIT] = TO(CSI_PARAM, PARAM), [CC_COLON] = TO(CSI_PARAM, SEPARATOR),
+		[CC_SEMI] = TO(CSI_PARAM, SEPARATOR), [CC_PRIVATE] = TO(CSI_IGNORE, IGNORE), [CC_FINAL] = TO(GROUND, CSI_DISPATCH),
+		[CC_CSI] = TO(GROUND, CSI_DISPATCH), [CC_OSC] = TO(GROUND, CSI_DISPATCH), [CC_DCS] = TO(GROUND, CSI_DISPATCH),
+		[CC_SOS] = TO(GROUND, CSI_DISPATCH),
+		[CC_DEL] = TO(CSI_PARAM, IGNORE), [CC_C1] = TO(CSI_IGNORE, IGNORE), [CC_HIGH] = TO(CSI_IGNORE, IGNORE),
+	},
+	[CSI_INTERMEDIATE] = {
+		[CC_C0] = TO(CSI_INTERMEDIATE, EXECUTE), [CC_BEL] = TO(CSI_INTERMEDIATE, EXECUTE), [CC_LF] = TO(CSI_INTERMEDIATE, EXECUTE),
+		ANYWHERE,
+		[CC_INTER] = TO(CSI_INTERMEDIATE, COLLECT), [CC_DIGIT] = TO(CSI_IGNORE, IGNORE), [CC_COLON] = TO(CSI_IGNORE, IGNORE),
+		[CC_SEMI] = TO(CSI_IGNORE, IGNORE), [CC_PRIVATE] = TO(CSI_IGNORE, IGNORE), [CC_FINAL] = TO(GROUND, CSI_DISPATCH),
+		[CC_CSI] = TO(GROUND, CSI_DISPATCH), [CC_OSC] = TO(GROUND, CSI_DISPATCH), [CC_DCS] = TO(GROUND, CSI_DISPATCH),
+		[CC_SOS] = TO(GROUND, CSI_DISPATCH),
+		[CC_DEL] = TO(CSI_INTERMEDIATE, IGNORE), [CC_C1] = TO(CSI_IGNORE, IGNORE), [CC_HIGH] = TO(CSI_IGNORE, IGNORE),
+	},
+	[CSI_IGNORE] = {
+		[CC_C0] = TO(CSI_IGNORE, EXECUTE), [CC_BEL] = TO(CSI_IGNORE, EXECUTE), [CC_LF] = TO(CSI_IGNORE, EXECUTE),
+		ANYWHERE,
+		[CC_INTER] = TO(CSI_IGNORE, IGNORE), [CC_DIGIT] = TO(CSI_IGNORE, IGNORE), [CC_COLON] = TO(CSI_IGNORE, IGNORE),
+		[CC_SEMI] = TO(CSI_IGNORE, IGNORE), [CC_PRIVATE] = TO(CSI_IGNORE, IGNORE), [CC_FINAL] = TO(GROUND, IGNORE),
+		[CC_CSI] = TO(GROUND, IGNORE), [CC_OSC] = TO(GROUND, IGNORE), [CC_DCS] = TO(GROUND, IGNORE),
+		[CC_SOS] = TO(GROUND, IGNORE),
+		[CC_DEL] = TO(CSI_IGNORE, IGNORE), [CC_C1] = TO(CSI_IGNORE, IGNORE), [CC_HIGH] = TO(CSI_IGNORE, IGNORE),
+	},
+	[DCS_ENTRY] = {
+		[CC_C0] = TO(DCS_ENTRY, IGNORE), [CC_BEL] = TO(DCS_ENTRY, IGNORE), [CC_LF] = TO(DCS_ENTRY, IGNORE),
+		ANYWHERE,
+		[CC_INTER] = TO(DCS_INTERMEDIATE, COLLECT), [CC_DIGIT] = TO(DCS_PARAM, PARAM), [CC_COLON] = TO(DCS_PARAM, SEPARATOR),
+		[CC_SEMI] = TO(DCS_PARAM, SEPARATOR), [CC_PRIVATE] = TO(DCS_PARAM, MARKER), [CC_FINAL] = TO(DCS_PASSTHROUGH, IGNORE),
+		[CC_CSI] = TO(DCS_PASSTHROUGH, IGNORE), [CC_OSC] = TO(DCS_PASSTHROUGH, IGNORE), [CC_DCS] = TO(DCS_PASSTHROUGH, IGNORE),
+		[CC_SOS] = TO(DCS_PASSTHROUGH, IGNORE),
+		[CC_DEL] = TO(DCS_ENTRY, IGNORE), [CC_C1] = TO(DCS_IGNORE, IGNORE), [CC_HIGH] = TO(DCS_IGNORE, IGNORE),
+	},
+	[DCS_PARAM] = {
+		[CC_C0] = TO(DCS_PARAM, IGNORE), [CC_BEL] = TO(DCS_PARAM, IGNORE), [CC_LF] = TO(DCS_PARAM, IGNORE),
+		ANYWHERE,
+		[CC_INTER] = TO(DCS_INTERMEDIATE, COLLECT), [CC_DIGIT] = TO(DCS_PARAM, PARAM), [CC_COLON] = TO(DCS_PARAM, SEPARATOR),
+		[CC_SEMI] = TO(DCS_PARAM, SEPARATOR), [CC_PRIVATE] = TO(DCS_IGNORE, IGNORE), [CC_FINAL] = TO(DCS_PASSTHROUGH, IGNORE),
+		[CC_CSI] = TO(DCS_PASSTHROUGH, IGNORE), [CC_OSC] = TO(DCS_PASSTHROUGH, IGNORE), [CC_DCS] = TO(DCS_PASSTHROUGH, IGNORE),
+		[CC_SOS] = TO(DCS_PASSTHROUGH, IGNORE),
+		[CC_DEL] = TO(DCS_PARAM, IGNORE), [CC_C1] = TO(DCS_IGNORE, IGNORE), [CC_HIGH] = TO(DCS_IGNORE, IGNORE),
+	},
+	[DCS_INTERMEDIATE] = {
+		[CC_C0] = TO(DCS_INTERMEDIATE, IGNORE), [CC_BEL] = TO(DCS_INTERMEDIATE, IGNORE), [CC_LF] = TO(DCS_INTERMEDIATE, IGNORE),
+		ANYWHERE,
+		[CC_INTER] = TO(DCS_INTERMEDIATE, COLLECT), [CC_DIGIT] = TO(DCS_IGNORE, IGNORE), [CC_COLON] = TO(DCS_IGNORE, IGNORE),
+		[CC_SEMI] = TO(DCS_IGNORE, IGNORE), [CC_PRIVATE] = TO(DCS_IGNORE, IGNORE), [CC_FINAL] = TO(DCS_PASSTHROUGH, IGNORE),
+		[CC_CSI] = TO(DCS_PASSTHROUGH, IGNORE), [CC_OSC] = TO(DCS_PASSTHROUGH, IGNORE), [CC_DCS] = TO(DCS_PASSTHROUGH, IGNORE),
+		[CC_SOS] = TO(DCS_PASSTHROUGH, IGNORE),
+		[CC_DEL] = TO(DCS_INTERMEDIATE, IGNORE), [CC_C1] = TO(DCS_IGNORE, IGNORE), [CC_HIGH] = TO(DCS_IGNORE, IGNORE),
+	},
+	[DCS_PASSTHROUGH] = {
+		[CC_C0] = TO(DCS_PASSTHROUGH, PUT), [CC_BEL] = TO(DCS_PASSTHROUGH, PUT), [CC_LF] = TO(DCS_PASSTHROUGH, PUT),
+		[CC_CANCEL] = TO(GROUND, IGNORE), [CC_ESC] = TO(ESCAPE, IGNORE),
+		[CC_INTER] = TO(DCS_PASSTHROUGH, PUT), [CC_DIGIT] = TO(DCS_PASSTHROUGH, PUT), [CC_COLON] = TO(DCS_PASSTHROUGH, PUT),
+		[CC_SEMI] = TO(DCS_PASSTHROUGH, PUT), [CC_PRIVATE] = TO(DCS_PASSTHROUGH, PUT), [CC_FINAL] = TO(DCS_PASSTHROUGH, PUT),
+		[CC_CSI] = TO(DCS_PASSTHROUGH, PUT), [CC_OSC] = TO(DCS_PASSTHROUGH, PUT), [CC_DCS] = TO(DCS_PASSTHROUGH, PUT),
+		[CC_SOS] = TO(DCS_PASSTHROUGH, PUT),
+		[CC_DEL] = TO(DCS_PASSTHROUGH, IGNORE), [CC_C1] = TO(GROUND, IGNORE), [CC_HIGH] = TO(DCS_PASSTHROUGH, PUT),
+	},
+	[DCS_IGNORE] = {
+		[CC_C0] = TO(DCS_IGNORE, IGNORE), [CC_BEL] = TO(DCS_IGNORE, IGNORE), [CC_LF] = TO(DCS_IGNORE, IGNORE),
+		[CC_CANCEL] = TO(GROUND, IGNORE), [CC_ESC] = TO(ESCAPE, IGNORE),
+		[CC_INTER] = TO(DCS_IGNORE, IGNORE), [CC_DIGIT] = TO(DCS_IGNORE, IGNORE), [CC_COLON] = TO(DCS_IGNORE, IGNORE),
+		[CC_SEMI] = TO(DCS_IGNORE, IGNORE), [CC_PRIVATE] = TO(DCS_IGNORE, IGNORE), [CC_FINAL] = TO(DCS_IGNORE, IGNORE),
+		[CC_CSI] = TO(DCS_IGNORE, IGNORE), [CC_OSC] = TO(DCS_IGNORE, IGNORE), [CC_DCS] = TO(DCS_IGNORE, IGNORE),
+		[CC_SOS] = TO(DCS_IGNORE, IGNORE),
+		[CC_DEL] = TO(DCS_IGNORE, IGNORE), [CC_C1] = TO(GROUND, IGNORE), [CC_HIGH] = TO(DCS_IGNORE, IGNORE),
+	},
+	// (strings are also ended by BEL and LF. the LF is nonstandard, but it keeps an unterminated string from eating everything)
+	[STRING] = {
+		[CC_C0] = TO(STRING, PUT), [CC_BEL] = TO(GROUND, IGNORE), [CC_LF] = TO(GROUND, IGNORE),
+		[CC_CANCEL] = TO(GROUND, IGNORE), [CC_ESC] = TO(ESCAPE, IGNORE),
+		[CC_INTER] = TO(STRING, PUT), [CC_DIGIT] = TO(STRING, PUT), [CC_COLON] = TO(STRING, PUT),
+		[CC_SEMI] = TO(STRING, PUT), [CC_PRIVATE] = TO(STRING, PUT), [CC_FINAL] = TO(STRING, PUT),
+		[CC_CSI] = TO(STRING, PUT), [CC_OSC] = TO(STRING, PUT), [CC_DCS] = TO(STRING, PUT),
+		[CC_SOS] = TO(STRING, PUT),
+		[CC_DEL] = TO(STRING, PUT), [CC_C1] = TO(GROUND, IGNORE), [CC_HIGH] = TO(STRING, PUT),
+	},
+};
+#undef ANYWHERE
+
+static const uint8_t ENTRY_ACTION[PARSE_STATES] = {
+	[ESCAPE] = CLEAR,
+	[CSI_ENTRY] = CLEAR,
+	[DCS_ENTRY] = CLEAR,
+	[DCS_PASSTHROUGH] = HOOK,
+	[STRING] = STRING_BEGIN,
+};
+
+static const uint8_t EXIT_ACTION[PARSE_STATES] = {
+	[DCS_PASSTHROUGH] = STRING_END,
+	[STRING] = STRING_END,
+};
+
+static void do_action(int action, Char c) {
+	switch (action) {
+	case IGNORE:
+		break;
+	case PRINT:
+		P.last_printed = c; //todo: when to reset this?
+		put_char(c);
+		break;
+	case EXECUTE:
+		process_control_char(c);
+		break;
+	case CLEAR:
+		P.argc = 1;
+		P.argv[0] = 0;
+		P.arg_colon[0] = false;
+		P.csi_private = 0;
+		P.intermediate = 0;
+		break;
+	case COLLECT:
+		P.intermediate = P.intermediate ? -1 : c;
+		break;
+	case MARKER:
+		P.csi_private = c;
+		break;
+	case PARAM:;
+		int* arg = &P.argv[P.argc-1];
+		if (*arg < 100000) // (just to avoid overflow)
+			*arg = *arg*10 + c-'0';
+		break;
+	case SEPARATOR:
+		// the purpose of the colons is to allow for argument grouping.
+		// because all the other codes are a single number, so if they are not supported, it's nbd
+		// but multi-number codes can cause frame shift issues, if they aren't supported, then the terminal will interpret the later values as individual args which is wrong.
+		// so the colons allow you to know how many values to skip in this case
+		if (P.argc < LEN(P.argv)) {
+			P.arg_colon[P.argc-1] = c==':';
+			P.argc++;
 		}
+		P.argv[P.argc-1] = 0;
+		P.arg_colon[P.argc-1] = false;
 		break;
-		// escape
-	case ESC:
+	case ESC_DISPATCH:
 		process_escape_char(c);
 		break;
-	case CSI_START:
-		P.state = CSI;
-		if (c=='?' || c=='>' || c=='!')
-			P.csi_private = c;
-		else {
-			P.csi_private = 0;
-			process_csi_char(c);
-		}
+	case CSI_DISPATCH:
+		process_csi_command(c);
 		break;
-	case CSI:
-		process_csi_char(c);
+	case HOOK:
+		P.dcs_final = c;
+		begin_string(DCS);
 		break;
-	case CSI_2:
-		process_csi_command_2(c);
+	case PUT:
+		push_string_bytes(1, &(utf8){c});
 		break;
-	case ALTCHARSET:
-		if (c=='0' || c=='B')
-			select_charset(P.charset, c);
-		else
-			print("unknown charset: %s\n", char_name(c));
-		P.state = NORMAL;
-		break;
-		// ???
-	case ST:
-		if (c=='\\') { // got ESC+backslash (end string)
-			end_string();
-		} else { // got ESC+<some other char> (add to string)
-			// todo: is this really the proper way to handle this
-			push_string_byte('\x1B');
-			push_string_byte(c);
-			P.state = STRING;
-		}
+	case STRING_BEGIN:
+		begin_string(c==']' ? OSC : c=='_' ? APC : c=='^' ? PM : SOS);
 		break;
-	default:
-		print("unknown parse state? (%d)\n", P.state);
-		P.state = NORMAL;
+	case STRING_END:
+		end_string();
+		break;
+	}
+}
+
+static void process_char(Char c) {
+	int t = TRANSITIONS[P.state][(unsigned)c<256 ? CHAR_CLASS[c] : CC_HIGH];
+	enum parse_state next = t & 15;
+	if (next == P.state) {
+		do_action(t>>4, c);
+	} else {
+		// (the state is set first, in case one of these actions causes more text to be processed)
+		enum parse_state prev = P.state;
+		P.state = next;
+		do_action(EXIT_ACTION[prev], c);
+		do_action(t>>4, c);
+		do_action(ENTRY_ACTION[next], c);
+	}
+}
+
+// whether `c` would be printed in the ground state
+static bool is_printable(Char c) {
+	return TRANSITIONS[GROUND][(unsigned)c<256 ? CHAR_CLASS[c] : CC_HIGH] == TO(GROUND, PRINT);
+}
+
+// find the length of the run at the start of `cs` where every byte is printable ascii (0x20-0x7E), or, if `printable` is false, where none are.
+// printable ascii doesn't need any utf-8 decoding or parsing, so it can be sent straight to the buffer
+static int printable_span(int len, const utf8 cs[len], bool printable) {
+	int i = 0;
+#ifdef __SSE2__
+	// check 16 bytes at a time
+	// (the comparisons are signed, so bytes ≥ 0x80 are negative and fail the first test)
+	const __m128i lower = _mm_set1_epi8(0x1F);
+	const __m128i upper = _mm_set1_epi8(0x7F);
+	for (; i+16<=len; i+=16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)&cs[i]);
+		__m128i ok = _mm_and_si128(_mm_cmpgt_epi8(v, lower), _mm_cmplt_epi8(v, upper));
+		int mask = _mm_movemask_epi8(ok);
+		int stop = printable ? ~mask & 0xFFFF : mask;
+		if (stop)
+			return i + __builtin_ctz(stop);
+	}
+#endif
+	for (; i<len; i++) {
+		unsigned char c = cs[i];
+		if ((c>=0x20 && c<0x7F) != printable)
+			break;
+	}
+	return i;
+}
+
+// process text in the ground state.
+// only the last byte of `cs` can be ESC
+static void process_text(int len, const utf8 cs[len]) {
+	Char chars[1024+1];
+	int i = 0;
+	while (i<len) {
+		// fast path for plain text
+		if (P.utf8.remaining == 0) {
+			int run = printable_span(len-i, &cs[i], true);
+			if (run) {
+				put_ascii(run, &cs[i]);
+				P.last_printed = (unsigned char)cs[i+run-1];
+				i += run;
+				continue;
+			}
+		}
+		// decode everything up to the next printable ascii char
+		int n = printable_span(len-i, &cs[i], false);
+		n = limit(n, 1, LEN(chars)-1);
+		int count = utf8_decode(&P.utf8, n, &cs[i], chars);
+		i += n;
+		// runs of printable chars are sent to the buffer together, and everything else goes through the parser
+		int j = 0;
+		while (j<count) {
+			int end = j;
+			while (end<count && is_printable(chars[end]))
+				end++;
+			if (end > j) {
+				put_chars(end-j, &chars[j]);
+				P.last_printed = chars[end-1];
+				j = end;
+			} else {
+				process_char(chars[j]);
+				j++;
+			}
+		}
 	}
 }
 
-static Char utf8_buffer = 0;
-static int utf8_remaining = 0;
 void process_chars(int len, const utf8 cs[len]) {
-	// 128, 192, 224, 240, 248
-	static const int8_t utf8_type[32] = {
-		// 0 - ascii byte
-		[16] = 1,1,1,1,1,1,1,1, // 1 - continuation byte
-		[24] = 2,2,2,2, // 2 - start of 2 byte sequence
-		[28] = 3,3, // 3 - start of 3 byte sequence
-		[30] = 4, // 4 - start of 4 byte sequence
-		[31] = -1, // invalid
-	};
-	
-	for (int i=0; i<len; i++) {
-		Char c = (unsigned char)cs[i]; //important! we need to convert to unsigned before casting to int
-		if (P.state == STRING) {
-			// start of ESC \ (string terminator)
-			if (c==0x1B)
-				P.state = ST;
-			// end of string
-			// todo: maybe check other characters here just in case
-			else if (c==0x07 || c==0x18 || c==0x1A || (c>=0x80 && c<=0x9F) || c=='\n') {
-				end_string();
+	// (each byte can add at most one new attribute to the table, or one new cluster)
+	reserve_attrs(len);
+	reserve_clusters(len);
+	// (an OSC 8 sequence is at least 6 bytes long, but one could have started in the previous chunk)
+	reserve_links(len/6+1);
+	int i = 0;
+	while (i<len) {
+		if (P.state >= DCS_PASSTHROUGH) {
+			// strings are read as raw bytes.
+			// runs of bytes which are just added to the string (or ignored) are handled all at once
+			int t = TRANSITIONS[P.state][CHAR_CLASS[(unsigned char)cs[i]]];
+			if (t==TO(P.state, PUT) || t==TO(P.state, IGNORE)) {
+				int end = i+1;
+				while (end<len && TRANSITIONS[P.state][CHAR_CLASS[(unsigned char)cs[end]]]==t)
+					end++;
+				if (t>>4 == PUT)
+					push_string_bytes(end-i, &cs[i]);
+				i = end;
 			} else {
-				push_string_byte(c);
+				process_char((unsigned char)cs[i]); //important! we need to convert to unsigned before casting to int
+				i++;
 			}
-		} else {
-			// outside of a string: start decoding utf-8
-			
-			int type = utf8_type[c>>3]; // figure out what type of utf-8 byte this is (number of leading 1 bits) using a lookup table
-			c = c & (1<<7-type)-1; // extract the data bits
-			// process the byte:
-			if (type==1) { // continuation byte
-				if (utf8_remaining>0) {
-					utf8_remaining--;
-					utf8_buffer |= c<<(6*utf8_remaining);
-					if (utf8_remaining==0)
-						process_char(utf8_buffer);
-				} else {
-					if (DEBUG.utf8)
-						print("Invalid utf8! unexpected continuation byte\n");
-				}
-			} else if (type==-1) { // invalid
-				if (DEBUG.utf8)
-					print("Invalid utf8! invalid byte\n");
-			} else { // start byte
-				if (utf8_remaining!=0) {
-					if (DEBUG.utf8)
-						print("Invalid utf8! interrupted sequence\n");
-					process_char(0xFFFD);
-				}
-				if (type==0) {
-					utf8_remaining = 0;
-					process_char(c);
-				} else {
-					utf8_remaining = type-1;
-					utf8_buffer = c<<(6*utf8_remaining);
+		} else if (P.state == GROUND) {
+			// in the ground state, only ESC can change the state,
+			// so everything up to the next ESC can be decoded at once
+			const utf8* esc = memchr(&cs[i], '\x1B', len-i);
+			int end = esc ? esc-cs : len;
+			if (end > i) {
+				process_text(end-i, &cs[i]);
+				i = end;
+			} else {
+				// SGR sequences are common enough to skip the parser entirely
+				int n = P.utf8.remaining ? 0 : process_sgr_sequence(len-i, &cs[i]);
+				if (!n) {
+					process_text(1, &cs[i]);
+					n = 1;
 				}
+				i += n;
 			}
+		} else {
+			// any char might change the state here, so go one byte at a time
+			Char chars[2];
+			int count = utf8_decode(&P.utf8, 1, &cs[i], chars);
+			i++;
+			FOR (j, count)
+				process_char(chars[j]);
 		}
 	}
-	//write_char(c[i]);
 }
 
 void reset_parser(void) {
-	utf8_remaining = 0;
-	utf8_buffer = 0;
-	P.state = NORMAL;
+	P.utf8 = (Utf8Decoder){0};
+	P.state = GROUND;
 	P.last_printed = -1;
 }
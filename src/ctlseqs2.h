@@ -2,18 +2,28 @@
 // This is for things which are shared between ctlseqs.c and csi.c
 
 #include "common.h"
+#include "utf8.h"
 
+// states of the parser state machine
+// these are the states from the DEC ANSI parser (https://vt100.net/emu/dec_ansi_parser)
+// except that OSC, SOS, PM, and APC all share the STRING state (P.string_command says which one it is)
 enum parse_state {
-	NORMAL,
-	ESC,
-	CSI_START,
-	CSI,
-	CSI_2,
-	ESC_TEST,
-	UTF8,
-	ALTCHARSET,
+	GROUND,
+	ESCAPE,
+	ESCAPE_INTERMEDIATE,
+	CSI_ENTRY,
+	CSI_PARAM,
+	CSI_INTERMEDIATE,
+	CSI_IGNORE,
+	DCS_ENTRY,
+	DCS_PARAM,
+	DCS_INTERMEDIATE,
+	// states after this point read raw bytes rather than decoded utf-8
+	DCS_PASSTHROUGH,
+	DCS_IGNORE,
 	STRING,
-	ST,
+	
+	PARSE_STATES,
 };
 
 enum string_command {
@@ -21,28 +31,30 @@ enum string_command {
 	APC,
 	PM,
 	OSC,
+	SOS,
 };
 
 typedef struct ParseState {
 	enum parse_state state;
+	Utf8Decoder utf8;
 	
-	utf8* string;
+	utf8* string; // (reused between strings)
 	int string_size;
 	enum string_command string_command;
-	int string_length;
+	int string_length; // -1 if the string was too long
+	void (*string_stream)(int len, utf8 data[len], bool end); // handler for the payload, if it's being streamed
 	
 	int argv[100];
 	bool arg_colon[100];
 	int argc;
-	Char csi_private;
-	Char csi_char;
-	
-	int charset;
+	Char csi_private; // private marker (one of `<=>?`) before the arguments
+	Char intermediate; // intermediate char (0x20-0x2F), -1 if there were multiple
+	Char dcs_final; // the char which ended the DCS header
 	
 	Char last_printed;
 } ParseState;
 
 extern ParseState P;
 
-void process_csi_char(Char c);
-void process_csi_command_2(Char c);
+void process_csi_command(Char c);
+int process_sgr_sequence(int len, const utf8 cs[len]);
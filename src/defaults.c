@@ -0,0 +1,42 @@
+// Default settings
+// (these are part of the terminal core, so they're available when running without X. `load_settings` overrides them)
+
+#include "common.h"
+#include "settings.h"
+
+Settings settings = {
+	.palette = {
+	  // dark colors
+		{  0,  0,  0}, // dark black
+		{170,  0,  0}, // dark red
+		{  0,170,  0}, // dark green
+		{170, 85,  0}, // dark yellow
+		{  0,  0,170}, // dark blue
+		{170,  0,170}, // dark magenta
+		{  0,170,170}, // dark cyan
+		{170,170,170}, // dark white
+		// light colors
+		{ 85, 85, 85}, // light black
+		{255, 85, 85}, // light red
+		{ 85,255, 85}, // light green
+		{255,255, 85}, // light yellow
+		{ 85, 85,255}, // light blue
+		{255, 85,255}, // light magenta
+		{ 85,255,255}, // light cyan
+		{255,255,255}, // light white
+	},
+	.cursorColor = {  0,192,  0},
+	.foreground = {255,255,255},
+	.background = {  0,  0,  0},
+	.cursorShape = 2,
+	.saveLines = 2000,
+	.spillLines = 0,
+	.scrollbackBytes = 0,
+	.width = 80,
+	.height = 24,
+	.faceName = "monospace",
+	.faceSize = 12,
+	.hyperlinkCommand = "xdg-open",
+	.termName = "xterm-12term",
+	.unicodeVersion = "",
+};
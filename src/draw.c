@@ -1,7 +1,5 @@
 // Drawing graphics
 
-#include <string.h>
-
 #include <X11/Xlib.h>
 #include "xft/Xft.h"
 
@@ -29,8 +27,11 @@ typedef struct XftDraw {
 } XftDraw;
 
 typedef struct DrawRow {
-	// cache of the glyphs and cells
-	Cell* cells;
+	// the row that was drawn here, and its generation at the time (see touch_row())
+	// (row is NULL if it needs to be drawn again)
+	const Row* row;
+	uint32_t generation;
+	// cache of the glyphs
 	Glyph* glyphs;
 	// framebuffer
 	XftDraw draw;
@@ -45,7 +46,7 @@ static Row* blank_row = NULL;
 // cursor
 static XftDraw cursor_draw = {0, 0};
 static int cursor_width; // in cells
-static int cursor_y; // cells
+static int cursor_x, cursor_y; // cells (where it was last painted)
 
 //Drawable frame_buffer = None;
 //GC fb_gc = None;
@@ -94,7 +95,7 @@ static void draw_destroy(XftDraw draw) {
 // todo: add _replace back? this only gets used on resize so is it worth it, idk?
 
 static int cell_fontstyle(const Cell* c) {
-	return (c->attrs.weight==1) | (c->attrs.italic)<<1;
+	return (cell_attrs(c)->weight==1) | (cell_attrs(c)->italic)<<1;
 }
 
 static void cells_to_glyphs(int len, Cell cells[len], Glyph glyphs[len], bool cache) {
@@ -127,7 +128,6 @@ void draw_resize(int width, int height, bool charsize) {
 	if (rows) {
 		FOR (i, drawn_height) {
 			FREE(rows[i].glyphs);
-			FREE(rows[i].cells);
 			draw_destroy(rows[i].draw);
 		}
 	}
@@ -136,18 +136,16 @@ void draw_resize(int width, int height, bool charsize) {
 	REALLOC(rows, height);
 	FOR (y, T.height) {
 		ALLOC(rows[y].glyphs, T.width);
-		ALLOC(rows[y].cells, T.width);
-		FOR (x, T.width) {
+		FOR (x, T.width)
 			rows[y].glyphs[x] = (Glyph){0}; // mreh
-			rows[y].cells[x] = (Cell){0}; //ehnnnn
-		}
+		rows[y].row = NULL;
 		rows[y].draw = draw_create(W.w, W.ch);
 		rows[y].redraw = true;
 	}
 	
 	resize_row(&blank_row, T.width, 0); // 0 should be old width but whatever
 	FOR (x, T.width) {
-		blank_row->cells[x] = (Cell){.attrs={.background={.i=-2}}};
+		blank_row->cells[x] = (Cell){.attr=0}; // (default attributes)
 	}
 	
 	// char size changing
@@ -171,15 +169,15 @@ static void draw_glyph(XftDraw draw, Px x, Px y, Glyph g, Color col, int w) {
 }
 
 // todo: make these thicker depending on dpi/fontsize
-static void draw_char_overlays(XftDraw draw, Px winx, Cell c) {
-	int underline = c.attrs.underline;
-	if (!(underline || c.attrs.strikethrough || c.attrs.link))
+static void draw_char_overlays(XftDraw draw, Px winx, Cell c, const Attrs* attrs) {
+	int underline = attrs->underline;
+	if (!(underline || attrs->strikethrough || attrs->link))
 		return;
-	Color underline_color = c.attrs.colored_underline ? c.attrs.underline_color : c.attrs.color;
+	Color underline_color = attrs->colored_underline ? attrs->underline_color : attrs->color;
 	int width = c.wide ? 2 : 1;
 	
 	// display a blue underline on hyperlinks (if they don't already have an underline)
-	if (c.attrs.link && !underline) {
+	if (attrs->link && !underline) {
 		underline = 1;
 		underline_color = (Color){.i=8+4}; //todo: maybe make a special palette entry for this purpose?
 	}
@@ -187,8 +185,8 @@ static void draw_char_overlays(XftDraw draw, Px winx, Cell c) {
 	if (underline) {
 		draw_rect(draw, underline_color, winx, W.font_baseline+1, width*W.cw, underline);
 	}
-	if (c.attrs.strikethrough) {
-		draw_rect(draw, c.attrs.color, winx, W.font_baseline*2/3, width*W.cw, 1);
+	if (attrs->strikethrough) {
+		draw_rect(draw, attrs->color, winx, W.font_baseline*2/3, width*W.cw, 1);
 	}
 }
 
@@ -198,13 +196,14 @@ static void draw_cursor(int x, int y) {
 	
 	xim_spot(x, y);
 	
-	Row* row = T.current->rows[y];
+	Row* row = current_row(y);
 	Cell temp;
 	if (row && x<T.width)
 		temp = row->cells[x];
 	else
 		temp = (Cell){0};
-	temp.attrs.color = temp.attrs.background;
+	Attrs attrs = *cell_attrs(&temp);
+	attrs.color = attrs.background;
 		
 	int width = temp.wide==1 ? 2 : 1;
 	
@@ -215,10 +214,10 @@ static void draw_cursor(int x, int y) {
 	if (temp.chr) {
 		Glyph spec[1];
 		cells_to_glyphs(1, &temp, spec, false);
-		draw_glyph(cursor_draw, 0, 0, spec[0], temp.attrs.color, width);
+		draw_glyph(cursor_draw, 0, 0, spec[0], attrs.color, width);
 	}
 	
-	draw_char_overlays(cursor_draw, 0, temp);
+	draw_char_overlays(cursor_draw, 0, temp, &attrs);
 	
 	cursor_width = width;
 }
@@ -260,28 +259,92 @@ void draw_rotate_rows(int y1, int y2, int amount, bool screen_space) {
 		rows[y].redraw = true;
 }
 
-static bool draw_row(int y, Row* row) {
+// get the range of cells covered by the glyph drawn in cell `x` (this can be wider than the cell, e.g. for italics)
+static void glyph_cells(const Row* row, int x, const GlyphData* g, int* x1, int* x2) {
+	// (see draw_glyph() and render_glyph())
+	float center = W.border + x*W.cw + (W.cw*(row->cells[x].wide==1 ? 2 : 1))/2.0;
+	Px left = (int)(center - g->metrics.xOff/2.0f + 10000) - 10000 - g->metrics.x - W.border;
+	Px right = left + g->metrics.width;
+	// (add a large number so the divisions round down)
+	*x1 = limit((left + 10000*W.cw)/W.cw - 10000, 0, T.width);
+	*x2 = limit((right + W.cw-1 + 10000*W.cw)/W.cw - 10000, 0, T.width);
+}
+
+// widen the range of cells `*x1`…`*x2-1` to cover all of the glyphs in it, and any glyphs which overhang into it
+// (so that redrawing those cells doesn't cut off part of a glyph)
+static void widen_span(const Row* row, const Glyph glyphs[], int* x1, int* x2) {
+	int start, end;
+	do {
+		start = *x1;
+		end = *x2;
+		// (glyphs are rarely more than a cell or two wider than their cells)
+		for (int x=limit(start-2, 0, T.width); x<limit(end+2, 0, T.width); x++) {
+			if (!glyphs[x].glyph)
+				continue;
+			int gx1, gx2;
+			glyph_cells(row, x, glyphs[x].glyph, &gx1, &gx2);
+			if (x>=*x1 && x<*x2 || gx1<*x2 && gx2>*x1) {
+				if (x < *x1)
+					*x1 = x;
+				if (x >= *x2)
+					*x2 = x+1;
+				if (gx1 < *x1)
+					*x1 = gx1;
+				if (gx2 > *x2)
+					*x2 = gx2;
+			}
+		}
+		// (don't split wide chars)
+		if (*x1>0 && row->cells[*x1].wide==-1)
+			(*x1)--;
+		if (*x2<T.width && row->cells[*x2-1].wide==1)
+			(*x2)++;
+	} while (*x1!=start || *x2!=end);
+}
+
+// draw a row into its framebuffer, if it has changed since it was last drawn there.
+// returns whether anything was drawn, and sets `x1`…`x2-1` to the cells that were
+static bool draw_row(int y, Row* row, int* x1, int* x2) {
+	*x1 = 0;
+	*x2 = T.width;
 	// see if row matches what's drawn onscreen
-	// todo: we don't store the wrap flags in here.
-	// so if you're debugging and want them visible, you must remove this line too
-	// todo: i think this is not working reliably?
-	if (!memcmp(&row->cells, rows[y].cells, sizeof(Cell)*T.width))
+	// (if you're debugging and want the wrap flags visible, you must touch_row() when they change too)
+	if (rows[y].row==row) {
+		if (rows[y].generation==row->generation)
+			return false;
+		// only the cells that changed need to be drawn
+		*x1 = limit(row->damage_start, 0, T.width);
+		*x2 = limit(row->damage_end, *x1, T.width);
+	}
+	rows[y].row = row;
+	rows[y].generation = row->generation;
+	row->damage_start = T.width;
+	row->damage_end = 0;
+	if (*x1 >= *x2)
 		return false;
-	memcpy(rows[y].cells, &row->cells, T.width*sizeof(Cell));
 	// if blank_row was passed (special case for scrollback out of bounds things)
 	if (row==blank_row) {
 		draw_rect(rows[y].draw, (Color){.truecolor=true,.rgb=T.background}, 0, 0, W.w, W.ch);
 		return true;
 	}
 	
+	// include the glyphs which were there before, and the new ones
+	Glyph* specs = rows[y].glyphs;
+	widen_span(row, specs, x1, x2);
+	cells_to_glyphs(*x2-*x1, &row->cells[*x1], &specs[*x1], true);
+	widen_span(row, specs, x1, x2);
+	cells_to_glyphs(*x2-*x1, &row->cells[*x1], &specs[*x1], true);
+	int start = *x1, end = *x2;
+	
 	// draw left border background
-	draw_rect(rows[y].draw, (Color){.i= /*row->cont?-3:*/-2}, 0, 0, W.border, W.ch);
+	if (start==0)
+		draw_rect(rows[y].draw, (Color){.i= /*row->cont?-3:*/-2}, 0, 0, W.border, W.ch);
 	// draw cell backgrounds
-	Color prev_color = row->cells[0].attrs.background;
-	int prev_start = 0;
+	Color prev_color = cell_attrs(&row->cells[start])->background;
+	int prev_start = start;
 	int x;
-	for (x=1; x<T.width; x++) {
-		Color bg = row->cells[x].attrs.background;
+	for (x=start+1; x<end; x++) {
+		Color bg = cell_attrs(&row->cells[x])->background;
 		if (!same_color(bg, prev_color)) {
 			draw_rect(rows[y].draw, prev_color, W.border+W.cw*prev_start, 0, W.cw*(x-prev_start), W.ch);
 			prev_start = x;
@@ -292,22 +355,20 @@ static bool draw_row(int y, Row* row) {
 	draw_rect(rows[y].draw, prev_color, W.border+W.cw*prev_start, 0, W.cw*(x-prev_start/*+1*/), W.ch);
 	
 	// draw right border background
-	draw_rect(rows[y].draw, (Color){.i = /*row->wrap?-3:*/-2}, W.border+W.cw*T.width, 0, W.border+W.cw, W.ch); // we add W.cw to the border width incase the window is slightly larger than it should be (i.e. in fullscreen)
+	if (end==T.width)
+		draw_rect(rows[y].draw, (Color){.i = /*row->wrap?-3:*/-2}, W.border+W.cw*T.width, 0, W.border+W.cw, W.ch); // we add W.cw to the border width incase the window is slightly larger than it should be (i.e. in fullscreen)
 	//draw_rect(rows[y].draw, (Color){.i = -3}, W.border+W.cw*row->length, 0, W.border, W.ch);
 	
 	// draw text
 	// todo: we need to handle combining chars here!!
-	Glyph* specs = rows[y].glyphs;
-	cells_to_glyphs(T.width, row->cells, specs, true);
-	
-	FOR (i, T.width) {
+	for (int i=start; i<end; i++) {
 		if (specs[i].glyph)
-			draw_glyph(rows[y].draw, W.border+i*W.cw, 0, specs[i], row->cells[i].attrs.color, row->cells[i].wide==1 ? 2 : 1);
+			draw_glyph(rows[y].draw, W.border+i*W.cw, 0, specs[i], cell_attrs(&row->cells[i])->color, row->cells[i].wide==1 ? 2 : 1);
 	}
 	
 	// draw strikethrough and underlines
-	FOR (x, T.width) {
-		draw_char_overlays(rows[y].draw, W.border+x*W.cw, row->cells[x]);
+	for (int x=start; x<end; x++) {
+		draw_char_overlays(rows[y].draw, W.border+x*W.cw, row->cells[x], cell_attrs(&row->cells[x]));
 	}
 	
 	return true;
@@ -331,9 +392,13 @@ static void copy_cursor_part(Px x, Px y, Px w, Px h, int cx, int cy) {
 
 // todo: vary thickness of cursors and lines based on font size
 
+// copy cells `x1`…`x2-1` of a row to the window (and the border, if they're at the edge), and draw the cursor if it's in this row
 // todo: keep better track of where cursor is rendered
-static void paint_row(int y) {
-	draw_put(rows[y].draw, 0, 0, W.w, W.ch, 0, W.border+W.ch*y);
+static void paint_row(int y, int x1, int x2) {
+	Px px1 = x1<=0 ? 0 : W.border+W.cw*x1;
+	Px px2 = x2>=T.width ? W.w : W.border+W.cw*x2;
+	if (px2 > px1)
+		draw_put(rows[y].draw, px1, 0, px2-px1, W.ch, px1, W.border+W.ch*y);
 	if (T.show_cursor && row_displayed_at(y)==T.c.y) {
 		switch (T.cursor_shape) {
 		case 0: // filled box
@@ -355,9 +420,9 @@ static void paint_row(int y) {
 			copy_cursor_part(W.cw*cursor_width-thick, thick, thick, W.ch-thick*2, T.c.x, y);
 			break;
 		}
+		cursor_x = T.c.x;
 		cursor_y = y;
 	}
-	rows[y].redraw = false;
 }
 
 void draw(bool repaint_all) {
@@ -368,8 +433,9 @@ void draw(bool repaint_all) {
 	// wait how does this work with scrolling?
 	// and yeah we don't need this every time
 	draw_cursor(T.c.x, T.c.y); // todo: do we need this every time?
+	// erase the cursor from where it was before (it's at most 2 cells wide)
 	if (cursor_y>=0 && cursor_y<T.height)
-		paint_row(cursor_y); // todo: not ideal ehh
+		paint_row(cursor_y, cursor_x, cursor_x+2);
 	if (repaint_all) {
 		// todo: erase the top/bottom borders here?
 	}
@@ -379,17 +445,17 @@ void draw(bool repaint_all) {
 		if (!row)
 			row = blank_row;
 		
-		bool paint = false;
-		if (draw_row(y, row)) {
-			paint = true;
-			if (DEBUG.dirty)
-				print(row==blank_row ? "~" : "#");
-		} else {
-			if (DEBUG.dirty)
-				print(".");
-		}
-		if (repaint_all || paint || T.c.y == y || rows[y].redraw)
-			paint_row(y);
+		int x1, x2;
+		bool paint = draw_row(y, row, &x1, &x2);
+		if (DEBUG.dirty)
+			print(!paint ? "." : row==blank_row ? "~" : x2-x1<T.width ? "+" : "#");
+		if (repaint_all || rows[y].redraw)
+			paint_row(y, 0, T.width);
+		else if (paint)
+			paint_row(y, x1, x2);
+		else if (row_displayed_at(y) == T.c.y)
+			paint_row(y, T.c.x, T.c.x+cursor_width);
+		rows[y].redraw = false;
 	}
 	if (DEBUG.dirty)
 		print("] ");
@@ -411,5 +477,7 @@ void dirty_cursor(void) {
 void dirty_all(void) {
 	FOR (y, T.height) {
 		rows[y].redraw = true;
+		// (and make sure draw_row doesn't skip the row, since the cells are the same even though their attributes have changed)
+		rows[y].row = NULL;
 	}
 }
@@ -143,9 +143,9 @@ static void on_buttonpress(XEvent* ev) {
 	case 1:; // left click
 		int x, y;
 		if (cell_at(ev->xbutton.x, ev->xbutton.y, &x, &y)) {
-			Cell* c = &T.current->rows[y]->cells[x];
-			if (c->attrs.link && c->attrs.link-1<T.links.length) {
-				char* url = T.links.items[c->attrs.link-1];
+			Cell* c = &current_row(y)->cells[x];
+			const utf8* url = link_url(cell_attrs(c)->link);
+			if (url) {
 				print("clicked hyperlink to: %s\n", url);
 				activate_hyperlink(url);
 			}
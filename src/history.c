@@ -0,0 +1,1115 @@
+// scrollback history
+
+#define _GNU_SOURCE // for SCHED_IDLE
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <zlib.h>
+#include <inttypes.h>
+
+#include "common.h"
+#include "buffer.h"
+#include "history.h"
+#include "settings.h"
+
+// == packed rows ==
+// most rows in the history are short lines of plain text, so storing them as full rows of `Cell`s wastes a lot of memory.
+// instead they're packed like this:
+// - the blank cells at the end of the row aren't stored (just their attributes, in .fill)
+// - the attributes are stored as runs of cells which have the same attributes
+// - the chars are stored as utf-8, with a flag byte (0xF8-0xFF, which can't appear in utf-8) before any cell that has a combining char or is part of a wide char
+//   if a cell has more than one combining char, each extra one comes after a 0xF8 byte (which is never used as a flag byte, since it has no flags set)
+
+typedef struct AttrSpan {
+	Attrs attrs;
+	int length; // number of cells
+} AttrSpan;
+
+typedef struct PackedRow {
+	int capacity; // number of bytes allocated
+	int size; // number of bytes used
+	int length; // number of cells stored (the rest are blank)
+	Attrs fill; // attributes of the blank cells at the end
+	int spans;
+	AttrSpan span[]; // followed by the text
+} PackedRow;
+
+// flags for cells with extra data
+enum {
+	CELL_COMBINING = 1,
+	CELL_WIDE = 2, // left half of wide char
+	CELL_WIDE_RIGHT = 4,
+	CELL_FLAGS = 0xF8,
+};
+
+static int encode_char(Char c, unsigned char out[4]) {
+	if (c<0 || c>0x1FFFFF)
+		c = 0xFFFD;
+	if (c<0x80) {
+		out[0] = c;
+		return 1;
+	} else if (c<0x800) {
+		out[0] = 0xC0 | c>>6;
+		out[1] = 0x80 | c&0x3F;
+		return 2;
+	} else if (c<0x10000) {
+		out[0] = 0xE0 | c>>12;
+		out[1] = 0x80 | c>>6&0x3F;
+		out[2] = 0x80 | c&0x3F;
+		return 3;
+	}
+	out[0] = 0xF0 | c>>18;
+	out[1] = 0x80 | c>>12&0x3F;
+	out[2] = 0x80 | c>>6&0x3F;
+	out[3] = 0x80 | c&0x3F;
+	return 4;
+}
+
+// (this only has to handle the output of encode_char)
+static int decode_char(const unsigned char in[4], Char* out) {
+	unsigned char b = in[0];
+	if (b<0x80) {
+		*out = b;
+		return 1;
+	} else if (b<0xE0) {
+		*out = (b&0x1F)<<6 | in[1]&0x3F;
+		return 2;
+	} else if (b<0xF0) {
+		*out = (b&0x0F)<<12 | (in[1]&0x3F)<<6 | in[2]&0x3F;
+		return 3;
+	}
+	*out = (b&0x07)<<18 | (in[1]&0x3F)<<12 | (in[2]&0x3F)<<6 | in[3]&0x3F;
+	return 4;
+}
+
+static bool is_blank(const Cell* cell, AttrId fill) {
+	return cell->chr==0 && cell->combining==0 && cell->wide==0 && cell->attr==fill;
+}
+
+// pack a row with T.width cells.
+// `old` is a packed row to reuse (or NULL), to avoid allocating a new one each time
+static PackedRow* pack_row(const Row* row, PackedRow* old) {
+	// (these are reused between calls)
+	static AttrSpan* spans = NULL;
+	static unsigned char* text = NULL;
+	static int width = 0, text_size = 0;
+	if (width < T.width) {
+		width = T.width;
+		REALLOC(spans, width);
+		text_size = width*9; // flags + 2 chars
+		REALLOC(text, text_size);
+	}
+	
+	AttrId fill = row->cells[T.width-1].attr;
+	int length = T.width;
+	while (length>0 && is_blank(&row->cells[length-1], fill))
+		length--;
+	
+	int count = 0;
+	int bytes = 0;
+	AttrId attr = 0;
+	FOR (x, length) {
+		const Cell* cell = &row->cells[x];
+		if (count && cell->attr==attr) {
+			spans[count-1].length++;
+		} else {
+			attr = cell->attr;
+			spans[count++] = (AttrSpan){*cell_attrs(cell), 1};
+		}
+		
+		// (most cells are just ascii)
+		if (!cell->combining && !cell->wide && cell->chr>=0 && cell->chr<0x80) {
+			text[bytes++] = cell->chr;
+			continue;
+		}
+		const Char* combining;
+		int count = cell_combining(cell, &combining);
+		// (each extra combining char takes up to 5 more bytes)
+		if (count>1 && bytes+count*5 + (length-x)*9 > text_size) {
+			text_size = (bytes+count*5 + (length-x)*9) * 2;
+			REALLOC(text, text_size);
+		}
+		int flags = (count ? CELL_COMBINING : 0) | (cell->wide==1 ? CELL_WIDE : 0) | (cell->wide==-1 ? CELL_WIDE_RIGHT : 0);
+		if (flags)
+			text[bytes++] = CELL_FLAGS | flags;
+		bytes += encode_char(cell->chr, &text[bytes]);
+		FOR (i, count) {
+			if (i)
+				text[bytes++] = CELL_FLAGS;
+			bytes += encode_char(combining[i], &text[bytes]);
+		}
+	}
+	
+	int size = sizeof(PackedRow) + sizeof(AttrSpan)*count + bytes;
+	// reuse the old allocation if it's big enough (but not if it's way too big)
+	PackedRow* new = old;
+	if (!new || new->capacity<size || new->capacity>size*2) {
+		new = realloc(old, size);
+		new->capacity = size;
+	}
+	new->size = size;
+	new->length = length;
+	new->fill = T.attr_table.items[fill];
+	new->spans = count;
+	memcpy(new->span, spans, sizeof(AttrSpan)*count);
+	memcpy(&new->span[count], text, bytes);
+	return new;
+}
+
+// unpack `count` cells, starting from cell `start`
+static void unpack_cells(const PackedRow* p, int start, int count, Cell out[count]) {
+	const unsigned char* text = (const unsigned char*)&p->span[p->spans];
+	const unsigned char* end = (const unsigned char*)p + p->size;
+	int length = p->length<start+count ? p->length : start+count;
+	int span = -1;
+	int left = 0;
+	AttrId attr = 0;
+	FOR (x, length) {
+		if (!left) {
+			left = p->span[++span].length;
+			// (only look up the attributes of spans that are used)
+			if (x+left > start)
+				attr = intern_attrs(p->span[span].attrs);
+		}
+		left--;
+		Cell cell = {.attr = attr};
+		int flags = 0;
+		if (*text >= CELL_FLAGS)
+			flags = *text++ & ~CELL_FLAGS;
+		text += decode_char(text, &cell.chr);
+		if (flags & CELL_COMBINING) {
+			Char combining[CLUSTER_MAX];
+			int count = 0;
+			do
+				text += decode_char(text, &combining[count++]);
+			while (text<end && *text==CELL_FLAGS && count<CLUSTER_MAX && text++);
+			// (only look up the ones that are used)
+			if (x >= start)
+				cell.combining = intern_cluster(count, combining);
+		}
+		cell.wide = flags&CELL_WIDE ? 1 : flags&CELL_WIDE_RIGHT ? -1 : 0;
+		if (x >= start)
+			out[x-start] = cell;
+	}
+	Cell blank = {.attr = intern_attrs(p->fill)};
+	for (int x=length>start?length:start; x<start+count; x++)
+		out[x-start] = blank;
+}
+
+// == blocks ==
+// the history is stored in blocks of BLOCK_ROWS rows.
+// old history is rarely looked at, so once a block is full (and isn't one of the newest few), it's compressed by a background thread.
+// compressed blocks are decompressed again when they're viewed, and a few of these are kept in `decompressed`
+
+#define BLOCK_ROWS 256
+#define HOT_BLOCKS 2 // number of full blocks which are never compressed
+
+typedef struct Block {
+	int count; // number of rows that have been added
+	PackedRow** rows; // BLOCK_ROWS items (NULL if compressed)
+	// compressed form of the rows (NULL if not compressed)
+	unsigned char* data;
+	int data_size;
+	int raw_size; // size of the data after decompressing it
+	int segment; // if the block was spilled to disk: the segment that `data` points into. otherwise -1
+	uint16_t* links; // hyperlinks used by the rows (the block holds a reference to each one, so they stay valid until it's freed)
+	int links_length, links_size;
+	
+	// (these are kept outside the compressed data, so the rows can be re-wrapped without decompressing them)
+	uint16_t cells[BLOCK_ROWS]; // number of cells in each row that are part of its line, + ROW_WRAP if the line continues onto the next row
+	int64_t offset; // position of the first remaining row within its line (in cells)
+	int64_t view_start; // view number of the first physical row that starts in this block
+} Block;
+
+#define ROW_WRAP 0x8000
+#define ROW_CELLS 0x7FFF // (widths above this are cut off)
+
+// the layout of a block before compression:
+// int offsets[BLOCK_ROWS+1]: the start of each row within the block (a row is empty if it was removed from the history)
+// followed by the rows (each padded to a multiple of 4 bytes)
+#define ROW_ALIGN 4
+
+static struct history {
+	int size; // maximum number of rows in memory
+	int max_length; // maximum number of rows, including ones on disk
+	int64_t bytes; // memory used by the blocks and the rows in them (not counting ones on disk), and the spare rows
+	int64_t max_bytes; // limit for `bytes` (0 = no limit)
+	int64_t cache_bytes; // memory used by the decompressed and unpacked copies (these aren't limited, since removing rows can't free them)
+	
+	// rows are numbered starting from when the history was cleared, so a row's number never changes
+	int64_t start; // number of the oldest row
+	int64_t end; // number of the next row to be added
+	int64_t line_offset; // position in its line where the next row would start, if it continues the newest line (otherwise 0)
+	
+	// the rows as they are viewed at the current width (see "== view ==")
+	int64_t view_end; // view number of the next physical row
+	int64_t counted_block; // blocks from this one onwards have their view_start counted at the current width
+	
+	// ring buffer of blocks. block number b holds rows b*BLOCK_ROWS … b*BLOCK_ROWS+BLOCK_ROWS-1
+	Block** blocks;
+	int blocks_size; // length of the ring
+	int first_slot; // slot of the oldest block
+	int blocks_count;
+	int64_t first_block; // number of the oldest block
+	
+	int compressed; // number of blocks at the start that are known to be compressed (the worker looks for blocks to compress after these)
+	int spilled; // number of blocks at the start that are on disk
+	int generation; // incremented when blocks change in a way that would invalidate the worker's current job
+	
+	PackedRow* spare[BLOCK_ROWS]; // rows from blocks which were compressed, to be reused
+	int spares;
+} history;
+
+// the history is shared with the worker thread, so this must be held while changing blocks
+static pthread_mutex_t history_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t worker_wake = PTHREAD_COND_INITIALIZER;
+
+static Block* block_at(int i) {
+	return history.blocks[(history.first_slot+i) % history.blocks_size];
+}
+
+// get the block that row number `r` is in
+static Block* block_of(int64_t r) {
+	return block_at(r/BLOCK_ROWS - history.first_block);
+}
+
+static unsigned char* serialize_block(const Block* b, int* size) {
+	int offsets[BLOCK_ROWS+1];
+	int pos = sizeof(offsets);
+	FOR (i, BLOCK_ROWS) {
+		offsets[i] = pos;
+		if (i<b->count && b->rows[i])
+			pos += (b->rows[i]->size+ROW_ALIGN-1) / ROW_ALIGN * ROW_ALIGN;
+	}
+	offsets[BLOCK_ROWS] = pos;
+	unsigned char* raw = malloc(pos);
+	memcpy(raw, offsets, sizeof(offsets));
+	FOR (i, BLOCK_ROWS) {
+		if (offsets[i+1] > offsets[i])
+			memcpy(raw+offsets[i], b->rows[i], b->rows[i]->size);
+	}
+	*size = pos;
+	return raw;
+}
+
+// get row `i` from a serialized block (or NULL if it's empty)
+static PackedRow* serialized_row(unsigned char* raw, int i) {
+	const int* offsets = (const int*)raw;
+	if (offsets[i+1] == offsets[i])
+		return NULL;
+	return (PackedRow*)(raw+offsets[i]);
+}
+
+static unsigned char* compress_raw(int raw_size, const unsigned char raw[raw_size], int* size) {
+	uLongf length = compressBound(raw_size);
+	unsigned char* data = malloc(length);
+	compress2(data, &length, raw, raw_size, 1);
+	*size = length;
+	return realloc(data, length);
+}
+
+// replace a block's rows with their compressed form
+static void install_compressed(Block* b, unsigned char* data, int size, int raw_size) {
+	b->data = data;
+	b->data_size = size;
+	b->raw_size = raw_size;
+	history.bytes += size - sizeof(PackedRow*)*BLOCK_ROWS;
+	FOR (i, BLOCK_ROWS) {
+		if (!b->rows[i])
+			continue;
+		// (spare rows are still counted in history.bytes)
+		if (history.spares < LEN(history.spare)) {
+			history.spare[history.spares++] = b->rows[i];
+		} else {
+			history.bytes -= b->rows[i]->capacity;
+			free(b->rows[i]);
+		}
+	}
+	FREE(b->rows);
+}
+
+static unsigned char* decompress_block(const Block* b) {
+	unsigned char* raw = malloc(b->raw_size);
+	uLongf size = b->raw_size;
+	if (uncompress(raw, &size, b->data, b->data_size) != Z_OK)
+		die("failed to decompress history block\n");
+	return raw;
+}
+
+// recently decompressed blocks (only used by the main thread)
+static struct decompressed {
+	const Block* block; // NULL if unused
+	unsigned char* raw;
+	int size; // (counted in history.cache_bytes)
+	int64_t used; // when this was last used (for finding the least recently used one)
+} decompressed[4];
+static int64_t decompressed_clock;
+
+static void forget_decompressed(const Block* b) {
+	FOR (i, LEN(decompressed)) {
+		if (decompressed[i].block == b) {
+			decompressed[i].block = NULL;
+			FREE(decompressed[i].raw);
+			history.cache_bytes -= decompressed[i].size;
+			decompressed[i].size = 0;
+		}
+	}
+}
+
+// get a row from a compressed block
+static PackedRow* compressed_row(const Block* b, int i) {
+	struct decompressed* d = &decompressed[0];
+	FOR (j, LEN(decompressed)) {
+		if (decompressed[j].block == b) {
+			d = &decompressed[j];
+			goto found;
+		}
+		if (decompressed[j].used < d->used)
+			d = &decompressed[j];
+	}
+	// not found: replace the least recently used one
+	free(d->raw);
+	d->raw = decompress_block(b);
+	history.cache_bytes += b->raw_size - d->size;
+	d->size = b->raw_size;
+	d->block = b;
+found:
+	d->used = ++decompressed_clock;
+	return serialized_row(d->raw, i);
+}
+
+static void release_segment(int s);
+
+static void free_data(Block* b) {
+	if (b->segment >= 0) {
+		release_segment(b->segment);
+		b->segment = -1;
+		b->data = NULL;
+	} else if (b->data) {
+		history.bytes -= b->data_size;
+		FREE(b->data);
+	}
+}
+
+// turn a compressed block back into separate rows
+static void thaw_block(Block* b) {
+	if (!b->data)
+		return;
+	unsigned char* raw = decompress_block(b);
+	ALLOC(b->rows, BLOCK_ROWS);
+	history.bytes += sizeof(PackedRow*)*BLOCK_ROWS;
+	FOR (i, BLOCK_ROWS) {
+		PackedRow* p = serialized_row(raw, i);
+		b->rows[i] = NULL;
+		if (p) {
+			b->rows[i] = malloc(p->size);
+			memcpy(b->rows[i], p, p->size);
+			b->rows[i]->capacity = p->size;
+			history.bytes += p->size;
+		}
+	}
+	free(raw);
+	free_data(b);
+	forget_decompressed(b);
+	history.generation++;
+}
+
+static void free_block(Block* b) {
+	if (b->rows) {
+		FOR (i, b->count) {
+			if (b->rows[i])
+				history.bytes -= b->rows[i]->capacity;
+			free(b->rows[i]);
+		}
+		free(b->rows);
+		history.bytes -= sizeof(PackedRow*)*BLOCK_ROWS;
+	}
+	FOR (i, b->links_length)
+		unref_link(b->links[i]);
+	free(b->links);
+	history.bytes -= sizeof(*b->links)*b->links_size;
+	free_data(b);
+	forget_decompressed(b);
+	free(b);
+	history.bytes -= sizeof(Block);
+}
+
+static void add_block_link(Block* b, int link) {
+	if (!link)
+		return;
+	// (rows next to each other usually have the same links)
+	for (int i=b->links_length-1; i>=0; i--)
+		if (b->links[i]==link)
+			return;
+	if (b->links_length == b->links_size) {
+		history.bytes -= sizeof(*b->links)*b->links_size;
+		b->links_size = b->links_size ? b->links_size*2 : 4;
+		REALLOC(b->links, b->links_size);
+		history.bytes += sizeof(*b->links)*b->links_size;
+	}
+	b->links[b->links_length++] = link;
+	ref_link(link);
+}
+
+// == spilling ==
+// when spilling is enabled, blocks older than the newest `saveLines` rows are appended to segment files, and read back through mmap.
+// the files are unlinked right after they're created, so they disappear when 12term exits (even if it crashes)
+
+#define SEGMENT_SIZE (16<<20)
+
+typedef struct Segment {
+	int fd; // -1 if the slot is unused
+	unsigned char* map; // `size` bytes
+	int size;
+	int length; // number of bytes written
+	int blocks; // number of blocks still stored here
+} Segment;
+
+static struct spill {
+	Segment* segments;
+	int segments_length;
+	int current; // segment which blocks are being appended to (-1 if none)
+	bool failed; // writing failed, so spilling has been turned off
+} spill = {.current = -1};
+
+static const utf8* spill_directory(void) {
+	if (settings.spillDirectory && settings.spillDirectory[0])
+		return settings.spillDirectory;
+	const utf8* dir = getenv("XDG_RUNTIME_DIR");
+	return dir && dir[0] ? dir : "/tmp";
+}
+
+// returns -1 if it fails
+static int open_segment(int size) {
+	utf8 path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/12term-scrollback-XXXXXX", spill_directory());
+	int fd = mkstemp(path);
+	if (fd<0) {
+		print("failed to create scrollback file %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	unlink(path);
+	// (the file is extended by writing to it, so only the parts which have been written are accessed)
+	unsigned char* map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map==MAP_FAILED) {
+		print("failed to map scrollback file: %s\n", strerror(errno));
+		close(fd);
+		return -1;
+	}
+	// find an unused slot
+	int s = 0;
+	while (s<spill.segments_length && spill.segments[s].fd>=0)
+		s++;
+	if (s==spill.segments_length)
+		REALLOC(spill.segments, ++spill.segments_length);
+	spill.segments[s] = (Segment){.fd = fd, .map = map, .size = size};
+	return s;
+}
+
+static void close_segment(int s) {
+	Segment* seg = &spill.segments[s];
+	munmap(seg->map, seg->size);
+	close(seg->fd);
+	seg->fd = -1;
+	if (spill.current == s)
+		spill.current = -1;
+}
+
+// called when a block stored in a segment is removed
+static void release_segment(int s) {
+	spill.segments[s].blocks--;
+	if (!spill.segments[s].blocks && s!=spill.current)
+		close_segment(s);
+}
+
+static void close_segments(void) {
+	FOR (s, spill.segments_length) {
+		if (spill.segments[s].fd >= 0)
+			close_segment(s);
+	}
+	FREE(spill.segments);
+	spill.segments_length = 0;
+	spill.current = -1;
+	spill.failed = false;
+}
+
+// move a (full) block to disk. returns false if it failed
+static bool spill_block(Block* b) {
+	if (spill.failed)
+		return false;
+	// compress it now if the worker hasn't gotten to it yet
+	if (!b->data) {
+		int raw_size, size;
+		unsigned char* raw = serialize_block(b, &raw_size);
+		unsigned char* data = compress_raw(raw_size, raw, &size);
+		free(raw);
+		install_compressed(b, data, size, raw_size);
+		history.generation++;
+	}
+	// start a new segment if this one is full
+	int s = spill.current;
+	if (s<0 || spill.segments[s].length+b->data_size > spill.segments[s].size) {
+		if (s>=0) {
+			spill.current = -1;
+			if (!spill.segments[s].blocks)
+				close_segment(s);
+		}
+		s = open_segment(b->data_size>SEGMENT_SIZE ? b->data_size : SEGMENT_SIZE);
+		if (s<0)
+			goto fail;
+		spill.current = s;
+	}
+	Segment* seg = &spill.segments[s];
+	if (pwrite(seg->fd, b->data, b->data_size, seg->length) != b->data_size) {
+		print("failed to write scrollback file: %s\n", strerror(errno));
+		goto fail;
+	}
+	free(b->data);
+	history.bytes -= b->data_size;
+	b->data = seg->map + seg->length;
+	b->segment = s;
+	seg->length += b->data_size;
+	seg->blocks++;
+	return true;
+fail:
+	spill.failed = true;
+	// keep the rows that fit in memory
+	history.max_length = history.size;
+	return false;
+}
+
+// == worker thread ==
+// this compresses full blocks, starting from the oldest.
+// the block is copied while holding the lock, and then compressed without it, so the main thread is only blocked briefly.
+// if the history changed in the meantime, the result is thrown away.
+
+static void* worker_main(void* arg) {
+#ifdef SCHED_IDLE
+	// run only when nothing else needs the cpu
+	pthread_setschedparam(pthread_self(), SCHED_IDLE, &(struct sched_param){0});
+#endif
+	pthread_mutex_lock(&history_lock);
+	while (1) {
+		// find the next block to compress
+		int i = history.compressed;
+		int limit = history.blocks_count-HOT_BLOCKS-1; // (the last block may not be full)
+		while (i<limit && block_at(i)->data)
+			i++;
+		history.compressed = i;
+		if (i>=limit) {
+			pthread_cond_wait(&worker_wake, &history_lock);
+			continue;
+		}
+		int64_t number = history.first_block+i;
+		int generation = history.generation;
+		int raw_size;
+		unsigned char* raw = serialize_block(block_at(i), &raw_size);
+		pthread_mutex_unlock(&history_lock);
+		
+		int size;
+		unsigned char* data = compress_raw(raw_size, raw, &size);
+		free(raw);
+		
+		pthread_mutex_lock(&history_lock);
+		// make sure the block is still there and hasn't changed
+		if (generation==history.generation && number>=history.first_block && number<history.first_block+history.blocks_count) {
+			// (rows which were removed since the block was copied are just left in the compressed data)
+			install_compressed(block_at(number-history.first_block), data, size, raw_size);
+		} else {
+			free(data);
+		}
+	}
+	return NULL;
+}
+
+static void start_worker(void) {
+	static bool started = false;
+	if (started)
+		return;
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, worker_main, NULL)) {
+		print("failed to start history compression thread\n");
+		return;
+	}
+	pthread_detach(thread);
+	started = true;
+}
+
+// == view ==
+// rows are stored at the width they had when they were added, but viewed at the current width:
+// the rows of each line (a sequence of rows where each one wraps onto the next) are joined, and split again every T.width cells.
+// only the number of cells in each row is needed to work out where the physical rows are, so resizing doesn't have to touch the stored rows.
+// physical rows are given "view numbers", which only change when the width does.
+
+static int64_t ceil_div(int64_t a, int b) {
+	return (a+b-1)/b;
+}
+
+// number of physical rows which start in a row with `cells` cells, at `offset` in its line
+// (a physical row starts every T.width cells, and an empty row at the start of a physical row gets its own)
+static int view_rows(int64_t offset, int cells) {
+	if (!cells)
+		return offset%T.width==0;
+	return ceil_div(offset+cells, T.width) - ceil_div(offset, T.width);
+}
+
+static int next_offset(int64_t offset, int cells) {
+	return cells&ROW_WRAP ? offset+(cells&ROW_CELLS) : 0;
+}
+
+static int first_row(int b) {
+	return b ? 0 : history.start % BLOCK_ROWS;
+}
+
+// (these only use the cell counts, so they don't need the lock)
+
+// count the physical rows at the current width, going back from the newest block until physical row `view` is reached
+// (after a resize, blocks are only counted when a row in or before them is needed)
+static void count_view(int64_t view) {
+	int64_t end = history.first_block+history.blocks_count;
+	int64_t n = history.counted_block;
+	if (n < history.first_block)
+		n = history.first_block;
+	if (n > end)
+		n = end;
+	while (n>history.first_block && (n==end || block_at(n-history.first_block)->view_start > view)) {
+		n--;
+		int i = n-history.first_block;
+		Block* b = block_at(i);
+		int64_t offset = b->offset;
+		int rows = 0;
+		for (int j=first_row(i); j<b->count; j++) {
+			rows += view_rows(offset, b->cells[j]&ROW_CELLS);
+			offset = next_offset(offset, b->cells[j]);
+		}
+		b->view_start = (n+1<end ? block_at(i+1)->view_start : history.view_end) - rows;
+	}
+	history.counted_block = n;
+}
+
+// whether physical row `view` is in the history (this counts the blocks up to it)
+static bool in_view(int64_t view) {
+	if (!history.blocks_count || view >= history.view_end)
+		return false;
+	count_view(view);
+	return view >= block_at(history.counted_block-history.first_block)->view_start;
+}
+
+typedef struct ViewPos {
+	int64_t row; // stored row where the physical row starts
+	int64_t offset; // position of that row in its line
+	int64_t start; // position of the physical row in the line
+} ViewPos;
+
+// find the stored row where physical row `view` starts
+// (the blocks must have been counted up to it)
+static ViewPos find_view_row(int64_t view) {
+	// find the last block which starts before it
+	int lo = history.counted_block-history.first_block, hi = history.blocks_count-1;
+	while (lo < hi) {
+		int mid = (lo+hi+1)/2;
+		if (block_at(mid)->view_start <= view)
+			lo = mid;
+		else
+			hi = mid-1;
+	}
+	Block* b = block_at(lo);
+	int64_t v = b->view_start;
+	int64_t offset = b->offset;
+	int j = first_row(lo);
+	for (; j<b->count-1; j++) {
+		int n = view_rows(offset, b->cells[j]&ROW_CELLS);
+		if (view < v+n)
+			break;
+		v += n;
+		offset = next_offset(offset, b->cells[j]);
+	}
+	return (ViewPos){
+		.row = (history.first_block+lo)*BLOCK_ROWS + j,
+		.offset = offset,
+		.start = (ceil_div(offset, T.width) + view-v) * T.width,
+	};
+}
+
+static int row_cells(int64_t r) {
+	return block_of(r)->cells[r % BLOCK_ROWS];
+}
+
+static PackedRow* get_packed(int64_t r) {
+	Block* b = block_of(r);
+	return b->rows ? b->rows[r % BLOCK_ROWS] : compressed_row(b, r % BLOCK_ROWS);
+}
+
+// unpack physical row `view` into `row`. returns the number of cells in it that are part of the line
+static int read_view_row(int64_t view, Row* row) {
+	ViewPos pos = find_view_row(view);
+	int64_t r = pos.row;
+	int64_t offset = pos.offset;
+	int x = 0;
+	bool wrap = false;
+	const PackedRow* p;
+	while (1) {
+		p = get_packed(r);
+		int cells = row_cells(r);
+		int from = pos.start+x - offset;
+		int n = (cells&ROW_CELLS) - from;
+		if (n > T.width-x)
+			n = T.width-x;
+		if (n > 0) {
+			unpack_cells(p, from, n, &row->cells[x]);
+			x += n;
+		}
+		if (x == T.width) {
+			wrap = from+n < (cells&ROW_CELLS) || cells&ROW_WRAP;
+			break;
+		}
+		if (!(cells&ROW_WRAP))
+			break;
+		// (the newest line might continue onto the screen)
+		if (r+1 == history.end) {
+			wrap = true;
+			break;
+		}
+		offset = next_offset(offset, cells);
+		r++;
+	}
+	int length = x;
+	// blank cells after the end of the line
+	if (x < T.width)
+		unpack_cells(p, p->length, T.width-x, &row->cells[x]);
+	// (wide chars which were split at the edge)
+	if (row->cells[0].wide == -1)
+		row->cells[0] = (Cell){.attr = row->cells[0].attr};
+	if (row->cells[T.width-1].wide == 1)
+		row->cells[T.width-1] = (Cell){.attr = row->cells[T.width-1].attr};
+	row->wrap = wrap;
+	row->cont = pos.start > 0;
+	return length;
+}
+
+// == history ==
+
+// recently unpacked rows, indexed by view number
+// (this should be at least as tall as the screen, so that all the visible rows fit when scrolled up)
+static struct cached_row {
+	int64_t number; // -1 if unused
+	Row* row; // T.width cells
+	int size; // (counted in history.cache_bytes)
+} cache[256];
+
+static struct cached_row* cache_entry(int64_t view) {
+	return &cache[view % LEN(cache)];
+}
+
+// forget the unpacked copy of a row, before it's changed
+static void uncache(int64_t view) {
+	struct cached_row* c = cache_entry(view);
+	if (c->number == view)
+		c->number = -1;
+}
+
+void history_forget_cache(void) {
+	FOR (i, LEN(cache))
+		cache[i].number = -1;
+}
+
+static void free_cache(void) {
+	FOR (i, LEN(cache)) {
+		cache[i].number = -1;
+		FREE(cache[i].row);
+		history.cache_bytes -= cache[i].size;
+		cache[i].size = 0;
+	}
+}
+
+void history_free_cache(void) {
+	pthread_mutex_lock(&history_lock);
+	free_cache();
+	FOR (i, LEN(decompressed)) {
+		decompressed[i].block = NULL;
+		FREE(decompressed[i].raw);
+		history.cache_bytes -= decompressed[i].size;
+		decompressed[i].size = 0;
+	}
+	pthread_mutex_unlock(&history_lock);
+}
+
+static void free_spares(void) {
+	FOR (i, history.spares) {
+		history.bytes -= history.spare[i]->capacity;
+		free(history.spare[i]);
+	}
+	history.spares = 0;
+}
+
+static void clear_history(void) {
+	if (history.blocks) {
+		FOR (i, history.blocks_count)
+			free_block(block_at(i));
+		FREE(history.blocks);
+	}
+	history.blocks_size = 0;
+	free_spares();
+	free_cache();
+	history.blocks_count = 0;
+	history.bytes = 0;
+	history.generation++;
+	close_segments();
+}
+
+void free_history(void) {
+	pthread_mutex_lock(&history_lock);
+	clear_history();
+	pthread_mutex_unlock(&history_lock);
+}
+
+// clear + init
+void init_history(void) {
+	start_worker();
+	pthread_mutex_lock(&history_lock);
+	clear_history();
+	
+	history.size = settings.saveLines;
+	history.max_length = history.size;
+	// rows on disk (-1 = unlimited)
+	if (history.size>0 && settings.spillLines)
+		history.max_length = settings.spillLines<0 || settings.spillLines>INT_MAX/2-history.size ? INT_MAX/2 : history.size+settings.spillLines;
+	history.max_bytes = settings.scrollbackBytes>0 ? settings.scrollbackBytes : 0;
+	// (the ring of blocks is allocated when the first row is added)
+	history.first_slot = 0;
+	history.first_block = 0;
+	history.compressed = 0;
+	history.spilled = 0;
+	
+	history.start = 0;
+	history.end = 0;
+	history.line_offset = 0;
+	history.view_end = 0;
+	pthread_mutex_unlock(&history_lock);
+	
+	T.scroll = 0;
+}
+
+int history_length(void) {
+	if (!history.blocks_count)
+		return 0;
+	count_view(INT64_MIN);
+	return history.view_end - block_at(0)->view_start;
+}
+
+// remove the oldest row. returns it, if it can be reused
+static PackedRow* drop_oldest(void) {
+	int64_t r = history.start++;
+	Block* b = block_of(r);
+	PackedRow* p = NULL;
+	if (b->rows) {
+		p = b->rows[r % BLOCK_ROWS];
+		b->rows[r % BLOCK_ROWS] = NULL;
+		if (p)
+			history.bytes -= p->capacity;
+	}
+	// (the rest of its line stays where it is)
+	int cells = b->cells[r % BLOCK_ROWS];
+	b->view_start += view_rows(b->offset, cells&ROW_CELLS);
+	b->offset = next_offset(b->offset, cells);
+	// free the block once all its rows are gone
+	if ((r+1) % BLOCK_ROWS == 0) {
+		free_block(b);
+		history.first_slot = (history.first_slot+1) % history.blocks_size;
+		history.first_block++;
+		history.blocks_count--;
+		if (history.compressed > 0)
+			history.compressed--;
+		if (history.spilled > 0)
+			history.spilled--;
+	}
+	return p;
+}
+
+// make the ring of blocks bigger (it starts small, so idle terminals with a large saveLines don't pay for it)
+static void grow_blocks(void) {
+	int size = history.blocks_size ? history.blocks_size*2 : 4;
+	Block** blocks;
+	ALLOC(blocks, size);
+	FOR (i, history.blocks_count)
+		blocks[i] = block_at(i);
+	free(history.blocks);
+	history.blocks = blocks;
+	history.blocks_size = size;
+	history.first_slot = 0;
+}
+
+// whether the rows in memory have used up scrollbackBytes
+// (the newest block's header isn't counted, since it stays after all the rows are removed)
+static bool over_budget(void) {
+	if (!history.max_bytes)
+		return false;
+	int64_t fixed = history.blocks_count ? sizeof(Block)+sizeof(PackedRow*)*BLOCK_ROWS : 0;
+	return history.bytes-fixed >= history.max_bytes;
+}
+
+// whether old blocks are being moved to disk
+static bool spilling(void) {
+	return history.max_length > history.size;
+}
+
+void history_push(const Row* row) {
+	if (history.size<=0)
+		return;
+	pthread_mutex_lock(&history_lock);
+	PackedRow* old = NULL;
+	// (these only speed up compressing, so they go first)
+	if (over_budget())
+		free_spares();
+	// reuse oldest item if necessary
+	// (when spilling, old rows are moved to disk instead of being removed when the memory runs out)
+	while (history.end-history.start >= history.max_length || !spilling() && over_budget() && history.end>history.start) {
+		PackedRow* p = drop_oldest();
+		if (old)
+			free(p);
+		else
+			old = p;
+	}
+	if (!old && history.spares) {
+		old = history.spare[--history.spares];
+		history.bytes -= old->capacity;
+	}
+	
+	// the newest physical row might get more cells now
+	uncache(history.view_end-1);
+	int64_t offset = history.line_offset;
+	if (offset && !row->cont) {
+		// the previous row said it continued, but this one doesn't
+		// (it might have been removed already, if a single row doesn't fit in scrollbackBytes)
+		if (history.end>history.start)
+			block_of(history.end-1)->cells[(history.end-1) % BLOCK_ROWS] &= ~ROW_WRAP;
+		offset = 0;
+	}
+	
+	int64_t r = history.end++;
+	if (r % BLOCK_ROWS == 0) {
+		// start a new block
+		if (history.blocks_count == history.blocks_size)
+			grow_blocks();
+		Block* b;
+		ALLOC(b, 1);
+		*b = (Block){.segment = -1, .offset = offset, .view_start = history.view_end};
+		ALLOC(b->rows, BLOCK_ROWS);
+		history.bytes += sizeof(Block) + sizeof(PackedRow*)*BLOCK_ROWS;
+		history.blocks[(history.first_slot+history.blocks_count) % history.blocks_size] = b;
+		if (!history.blocks_count)
+			history.first_block = r/BLOCK_ROWS;
+		history.blocks_count++;
+	}
+	Block* b = block_of(r);
+	PackedRow* p = pack_row(row, old);
+	b->rows[b->count] = p;
+	history.bytes += p->capacity;
+	FOR (i, p->spans)
+		add_block_link(b, p->span[i].attrs.link);
+	add_block_link(b, p->fill.link);
+	// (a row that wraps includes the blank cells at the end)
+	int cells = row->wrap ? T.width : p->length;
+	if (cells > ROW_CELLS)
+		cells = ROW_CELLS;
+	b->cells[b->count] = cells | (row->wrap ? ROW_WRAP : 0);
+	b->count++;
+	history.view_end += view_rows(offset, cells);
+	history.line_offset = next_offset(offset, b->cells[b->count-1]);
+	// move the oldest block in memory to disk, once the newer rows fill the in-memory part of the history (or use up its memory)
+	while (spilling() && history.spilled<history.blocks_count) {
+		int64_t next = (history.first_block+history.spilled+1) * BLOCK_ROWS;
+		if (history.end<next || history.end-next<history.size && !over_budget())
+			break;
+		if (!spill_block(block_at(history.spilled)))
+			break;
+		history.spilled++;
+	}
+	// a block was filled, so there might be one to compress now
+	if (b->count == BLOCK_ROWS) {
+		pthread_cond_signal(&worker_wake);
+		if (DEBUG.memory)
+			print("history: %"PRId64" rows, %"PRId64" bytes in memory (+ %"PRId64" bytes of cache)\n", history.end-history.start, history.bytes, history.cache_bytes);
+	}
+	pthread_mutex_unlock(&history_lock);
+}
+
+// remove the newest stored row
+static void pop_stored(void) {
+	int64_t r = --history.end;
+	Block* b = block_of(r);
+	if (b->data) {
+		thaw_block(b);
+		history.compressed = limit(history.compressed, 0, r/BLOCK_ROWS - history.first_block);
+		history.spilled = limit(history.spilled, 0, r/BLOCK_ROWS - history.first_block);
+	}
+	b->count--;
+	if (b->rows[b->count])
+		history.bytes -= b->rows[b->count]->capacity;
+	FREE(b->rows[b->count]);
+	// remove the block if it's empty now
+	if (b->count == 0) {
+		free_block(b);
+		history.blocks_count--;
+	}
+}
+
+int history_pop(Row* row) {
+	// check length
+	if (!in_view(history.view_end-1))
+		return -1;
+	pthread_mutex_lock(&history_lock);
+	int64_t view = --history.view_end;
+	uncache(view);
+	int length = read_view_row(view, row);
+	// remove the part of the line that was in this row
+	ViewPos pos = find_view_row(view);
+	while (history.end-1 > pos.row)
+		pop_stored();
+	if (pos.offset < pos.start) {
+		// the row where it starts is cut off (and now continues onto the screen)
+		block_of(pos.row)->cells[pos.row % BLOCK_ROWS] = (pos.start-pos.offset) | ROW_WRAP;
+	} else {
+		pop_stored();
+	}
+	history.line_offset = pos.start;
+	history.generation++;
+	pthread_mutex_unlock(&history_lock);
+	return length;
+}
+
+Row* history_row(int n) {
+	int64_t view = history.view_end-n;
+	if (n<1 || !in_view(view))
+		return NULL;
+	struct cached_row* c = cache_entry(view);
+	if (c->number != view) {
+		pthread_mutex_lock(&history_lock);
+		if (!c->row) {
+			c->size = sizeof(Row) + sizeof(Cell)*T.width;
+			c->row = malloc(c->size);
+			history.cache_bytes += c->size;
+		}
+		read_view_row(view, c->row);
+		touch_row(c->row);
+		c->number = view;
+		pthread_mutex_unlock(&history_lock);
+	}
+	return c->row;
+}
+
+void history_reflow(void) {
+	pthread_mutex_lock(&history_lock);
+	free_cache();
+	pthread_mutex_unlock(&history_lock);
+	// the blocks are counted again backwards from here when they're needed
+	// (a stored row is never more than ROW_CELLS physical rows, so view numbers stay positive)
+	history.view_end = (history.end-history.start+1) * ROW_CELLS;
+	history.counted_block = history.first_block+history.blocks_count;
+}
@@ -0,0 +1,27 @@
+#pragma once
+// Scrollback history
+// rows are packed into a compact format when they scroll off the top of the screen, and unpacked again when they're viewed
+// lines which wrapped onto multiple rows are re-wrapped when the width changes
+// old rows are grouped into blocks, which are compressed by a background thread
+
+#include "common.h"
+#include "buffer.h"
+
+void init_history(void);
+void free_history(void);
+int history_length(void);
+// add a copy of a row (with T.width cells) to the history, dropping the oldest one if it's full
+void history_push(const Row* row);
+// remove the most recent row, and unpack it into `row` (which must have T.width cells)
+// returns the number of cells in it which are part of its line (the rest are blank), or -1 if the history is empty
+int history_pop(Row* row);
+// get the `n`th most recent row (1 … history_length())
+// the returned row is only valid until the history changes (or until enough other rows have been viewed to push it out of the cache)
+Row* history_row(int n);
+// forget all the unpacked rows (after the attribute table is renumbered)
+void history_forget_cache(void);
+// free the unpacked and decompressed rows (when the history isn't being viewed)
+void history_free_cache(void);
+// re-wrap the rows after T.width changes
+// (rows keep the width they were added with, and are re-wrapped when they're read, so this doesn't have to look at them)
+void history_reflow(void);
@@ -0,0 +1,49 @@
+// Default host callbacks (for running the terminal without a window)
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "common.h"
+#include "host.h"
+
+static void default_set_title(utf8* title) {
+}
+
+static void default_set_clipboard(utf8* which, utf8* data) {
+	free(data);
+}
+
+static void default_change_font(const utf8* name) {
+}
+
+static bool default_parse_color(const utf8* name, RGBColor* out) {
+	return false;
+}
+
+static void default_write(size_t len, const utf8 data[len]) {
+}
+
+static void default_dirty_all(void) {
+}
+
+static void default_rotate_rows(int y1, int y2, int amount, bool screen_space) {
+}
+
+Host host = {
+	.set_title = default_set_title,
+	.set_clipboard = default_set_clipboard,
+	.change_font = default_change_font,
+	.parse_color = default_parse_color,
+	.write = default_write,
+	.dirty_all = default_dirty_all,
+	.rotate_rows = default_rotate_rows,
+};
+
+void host_printf(const utf8* format, ...) {
+	va_list ap;
+	va_start(ap, format);
+	static utf8 buf[1024];
+	int len = vsnprintf(buf, LEN(buf), format, ap);
+	va_end(ap);
+	host.write(limit(len, 0, LEN(buf)-1), buf);
+}
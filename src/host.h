@@ -0,0 +1,22 @@
+#pragma once
+// Interface between the terminal core (buffer.c, ctlseqs.c, csi.c, ...) and the program displaying it
+// the core doesn't depend on X, so it can also be run headless (see `make core`)
+
+#include "common.h"
+#include "buffer.h"
+
+typedef struct Host {
+	void (*set_title)(utf8* title); // (NULL = default title)
+	void (*set_clipboard)(utf8* which, utf8* data); // (takes ownership of `data`)
+	void (*change_font)(const utf8* name);
+	bool (*parse_color)(const utf8* name, RGBColor* out);
+	void (*write)(size_t len, const utf8 data[len]); // send a reply to the application
+	// damage
+	void (*dirty_all)(void); // everything needs to be redrawn
+	void (*rotate_rows)(int y1, int y2, int amount, bool screen_space); // rows y1…y2-1 were scrolled
+} Host;
+
+// these are set to functions that do nothing, by default
+extern Host host;
+
+void host_printf(const utf8* format, ...) __attribute__((format(printf, 1, 2)));
@@ -1,5 +1,5 @@
 // note: this is NOT a configuration file!
-// it just contains functions for loading settings, and their default values
+// it just contains functions for loading settings (the default values are in defaults.c)
 // see `xresources-example.ad` for more information
 
 #include <X11/Xresource.h>
@@ -27,40 +27,6 @@ bool parse_x_color(const utf8* c, RGBColor* out) {
 	return false;
 }
 
-Settings settings = {
-	.palette = {
-	  // dark colors
-		{  0,  0,  0}, // dark black
-		{170,  0,  0}, // dark red
-		{  0,170,  0}, // dark green
-		{170, 85,  0}, // dark yellow
-		{  0,  0,170}, // dark blue
-		{170,  0,170}, // dark magenta
-		{  0,170,170}, // dark cyan
-		{170,170,170}, // dark white
-		// light colors
-		{ 85, 85, 85}, // light black
-		{255, 85, 85}, // light red
-		{ 85,255, 85}, // light green
-		{255,255, 85}, // light yellow
-		{ 85, 85,255}, // light blue
-		{255, 85,255}, // light magenta
-		{ 85,255,255}, // light cyan
-		{255,255,255}, // light white
-	},
-	.cursorColor = {  0,192,  0},
-	.foreground = {255,255,255},
-	.background = {  0,  0,  0},
-	.cursorShape = 2,
-	.saveLines = 2000,
-	.width = 80,
-	.height = 24,
-	.faceName = "monospace",
-	.faceSize = 12,
-	.hyperlinkCommand = "xdg-open",
-	.termName = "xterm-12term",
-};
-
 XrmDatabase	db = NULL;
 
 static bool get_string(utf8* name, utf8** out) {
@@ -117,6 +83,20 @@ static bool get_integer(utf8* name, int* out) {
 	return false;
 }
 
+// (for sizes in bytes, which can be bigger than an int)
+static bool get_size(utf8* name, int64_t* out) {
+	utf8* str;
+	if (get_string(name, &str)) {
+		utf8* end;
+		long long n = strtoll(str, &end, 0);
+		if (str[0]!='\0' && *end=='\0') {
+			*out = n;
+			return true;
+		}
+	}
+	return false;
+}
+
 static bool get_boolean(utf8* name, bool* out) {
 	utf8* str;
 	if (get_string(name, &str)) {
@@ -169,7 +149,11 @@ void load_settings(int* argc, utf8** argv) {
 	get_color(FIELD(background));
 	get_color(FIELD(foreground));
 	get_integer(FIELD(saveLines));
+	get_integer(FIELD(spillLines));
+	get_size(FIELD(scrollbackBytes));
+	get_string(FIELD(spillDirectory));
 	get_string(FIELD(termName));
+	get_string(FIELD(unicodeVersion));
 	// first 16 palette colors
 	for (int i=0; i<16; i++) {
 		utf8 buf[100];
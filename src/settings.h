@@ -1,5 +1,4 @@
 #pragma once
-#include <fontconfig/fontconfig.h>
 
 #include "buffer.h"
 
@@ -18,6 +17,10 @@ typedef struct Settings {
 	utf8* hyperlinkCommand;
 	utf8* termName;
 	int saveLines;
+	int spillLines;
+	int64_t scrollbackBytes;
+	utf8* spillDirectory;
+	utf8* unicodeVersion;
 	
 	struct {
 		bool antialias;
@@ -36,8 +39,3 @@ typedef struct Settings {
 extern Settings settings;
 
 void load_settings(int* argc, utf8** argv);
-
-void pattern_default_substitute(FcPattern* pattern);
-
-// should this be in here?
-bool parse_x_color(const utf8* c, RGBColor* out);
@@ -0,0 +1,69 @@
+// Tests for the scrollback history, run without X
+// usage: 12term-test
+// prints one line per test, and exits with status 1 if any of them failed
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "../common.h"
+#include "../buffer.h"
+#include "../ctlseqs.h"
+#include "../history.h"
+#include "../settings.h"
+
+static bool failed = false;
+
+static void check(bool ok, const utf8* name) {
+	printf("%s: %s\n", ok ? "ok" : "FAILED", name);
+	if (!ok)
+		failed = true;
+}
+
+static void write_lines(int count) {
+	static int number = 0;
+	FOR (i, count) {
+		utf8 line[100];
+		int length = snprintf(line, sizeof(line), "line %d: the quick brown fox jumps over the lazy dog\r\n", number++);
+		process_chars(length, line);
+	}
+}
+
+// view the rows that fill the cache of unpacked rows, then add more lines.
+// the rows in the cache aren't part of the scrollbackBytes limit, so this shouldn't remove the rows that are in the history
+static void test_cache_budget(int64_t budget) {
+	settings.saveLines = 100000;
+	settings.spillLines = 0;
+	settings.scrollbackBytes = budget;
+	init_term(300, 50);
+	
+	write_lines(20000);
+	int before = history_length();
+	FOR (i, 256)
+		get_row(-1-i);
+	write_lines(2000);
+	int after = history_length();
+	
+	utf8 name[100];
+	snprintf(name, sizeof(name), "scrollbackBytes=%"PRId64": %d rows before viewing the history, %d after", budget, before, after);
+	check(before>256 && after>=before*9/10, name);
+	
+	// scrolling back and down again
+	set_scrollback(256);
+	FOR (y, T.height)
+		get_row(y);
+	set_scrollback(0);
+	write_lines(2000);
+	int scrolled = history_length();
+	snprintf(name, sizeof(name), "scrollbackBytes=%"PRId64": %d rows after scrolling back", budget, scrolled);
+	check(scrolled>=before*9/10, name);
+}
+
+int main(void) {
+	debug_enabled = false;
+	// (the cache of unpacked rows alone would be bigger than this)
+	int64_t cache_size = (sizeof(Row)+300*sizeof(Cell))*256;
+	test_cache_budget(cache_size/2);
+	test_cache_budget(1000000);
+	test_cache_budget(2000000);
+	return failed;
+}
@@ -141,50 +141,47 @@ void tty_printf(const char* format, ...) {
 	tty_write(len, buf);
 }
 
-static int min(int a, int b) {
-	return a<b ? a : b;
-}
+// data waiting to be sent to the child process.
+// writes are queued rather than done immediately, so that (for example) replies from the parser can never block,
+// or cause more output to be read and parsed while the parser is in the middle of a sequence.
+// the main loop calls `tty_flush` to send it
+static struct {
+	char* data;
+	size_t start, end, size;
+} out;
 
 // send data to child process (i.e. keypresses)
 void tty_write(size_t len, const char str[len]) {
-	const char* pos = str;
-	fd_set write_fds, read_fds;
-	size_t lim = 256;
-	while (len > 0) {
-		// wait for uhhhh
-		FD_ZERO(&write_fds);
-		FD_ZERO(&read_fds);
-		FD_SET(master_fd, &write_fds);
-		FD_SET(master_fd, &read_fds);
-		if (pselect(master_fd+1, &read_fds, &write_fds, NULL, NULL, NULL) < 0) {
-			if (errno==EINTR || errno==EAGAIN)
-				continue;
-			die("select failed: %s\n", strerror(errno));
+	if (out.end+len > out.size) {
+		// move the remaining data back to the start
+		memmove(out.data, out.data+out.start, out.end-out.start);
+		out.end -= out.start;
+		out.start = 0;
+		if (out.end+len > out.size) {
+			out.size = (out.end+len)*2;
+			REALLOC(out.data, out.size);
 		}
-		
-		if (FD_ISSET(master_fd, &write_fds)) {
-			// Only write the bytes written by ttywrite() or the
-			// default of 256. This seems to be a reasonable value
-			// for a serial line. Bigger values might clog the I/O.
-			ssize_t written = write(master_fd, pos, min(len, lim));
-			if (written < 0) {
-				die("write error on tty: %s\n", strerror(errno));
-			} else if (written >= len) {
-				// finished
-				break;
-			} else {
-				// We weren't able to write out everything.
-				// This means the buffer is getting full
-				// again. Empty it.
-				if (len < lim)
-					lim = tty_read();
-				len -= written;
-				pos += written;
-			}
+	}
+	memcpy(out.data+out.end, str, len);
+	out.end += len;
+}
+
+// write as much of the queue as possible, without blocking
+// returns true if there's still data left
+bool tty_flush(void) {
+	while (out.start < out.end) {
+		ssize_t written = write(master_fd, out.data+out.start, out.end-out.start);
+		if (written < 0) {
+			if (errno==EINTR)
+				continue;
+			if (errno==EAGAIN)
+				return true;
+			die("write error on tty: %s\n", strerror(errno));
 		}
-		if (FD_ISSET(master_fd, &read_fds))
-			lim = tty_read();
+		out.start += written;
 	}
+	out.start = out.end = 0;
+	return false;
 }
 
 void tty_hangup(void) {
@@ -210,13 +207,18 @@ static int max(int a, int b) {
 }
 
 //wait until data is recieved on either master_fd (the fd used to communicate with the child) OR xfd (notifies when x events are recieved)
+// (or until master_fd is writable, if the write queue isn't empty)
 // returns true if data was recvd on master_fd
 bool tty_wait(Fd xfd, Nanosec timeout) {
-	fd_set rfd;
+	fd_set rfd, wfd;
 	while (1) {
 		FD_ZERO(&rfd);
 		FD_SET(master_fd, &rfd);
 		FD_SET(xfd, &rfd);
+		// if there's data waiting to be written, also wake up when we can write it
+		FD_ZERO(&wfd);
+		if (out.start < out.end)
+			FD_SET(master_fd, &wfd);
 		
 		struct timespec seltv = {
 			.tv_sec = timeout/(1000*1000*1000),
@@ -224,7 +226,7 @@ bool tty_wait(Fd xfd, Nanosec timeout) {
 		};
 		struct timespec* tv = timeout>=0 ? &seltv : NULL;
 		
-		if (pselect(max(xfd, master_fd)+1, &rfd, NULL, NULL, tv, NULL) < 0) {
+		if (pselect(max(xfd, master_fd)+1, &rfd, &wfd, NULL, tv, NULL) < 0) {
 			if (!(errno==EINTR || errno==EAGAIN))
 				die("select failed: %s\n", strerror(errno));
 		} else
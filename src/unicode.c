@@ -0,0 +1,79 @@
+// char widths (see unicode.h)
+
+#define _XOPEN_SOURCE 600
+#include <wchar.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+
+#include "common.h"
+#include "unicode.h"
+#include "unicode_tables.h"
+
+// the current table (NULL = use wcwidth())
+static const struct width_table* current = &width_tables[LEN(width_tables)-1];
+
+// parse "major", "major.minor", or "major.minor.update" (the update number is ignored)
+// minor is INT_MAX if it's missing, so that the newest table for that major version is chosen
+static bool parse_version(const utf8* str, int* major, int* minor) {
+	utf8* end;
+	*major = strtol(str, &end, 10);
+	if (end==str)
+		return false;
+	*minor = INT_MAX;
+	if (*end=='.') {
+		str = end+1;
+		*minor = strtol(str, &end, 10);
+		if (end==str)
+			return false;
+		if (*end=='.') {
+			str = end+1;
+			strtol(str, &end, 10);
+			if (end==str)
+				return false;
+		}
+	}
+	return *end=='\0';
+}
+
+bool set_unicode_version(const utf8* version) {
+	current = &width_tables[LEN(width_tables)-1];
+	if (!version || !version[0])
+		return true;
+	if (!strcmp(version, "libc")) {
+		current = NULL;
+		return true;
+	}
+	int major, minor;
+	if (!parse_version(version, &major, &minor))
+		return false;
+	// the newest table that isn't newer than `version`
+	// (or the oldest one, if they all are)
+	bool exact = false;
+	current = &width_tables[0];
+	FOR (i, LEN(width_tables)) {
+		int m, n;
+		parse_version(width_tables[i].version, &m, &n);
+		if (m>major || m==major && n>minor)
+			break;
+		current = &width_tables[i];
+		exact = m==major && (n==minor || minor==INT_MAX);
+	}
+	return exact;
+}
+
+const utf8* unicode_version(void) {
+	return current ? current->version : "libc";
+}
+
+int unicode_width(Char c) {
+	if (!current) {
+		int width = wcwidth(c);
+		return width<0 ? 1 : width;
+	}
+	if (c<0 || c>=0x110000)
+		return 1;
+	int block = current->blocks[c >> WIDTH_BLOCK_BITS];
+	int i = c & (1<<WIDTH_BLOCK_BITS)-1;
+	return width_blocks[block][i>>2] >> (i&3)*2 & 3;
+}
@@ -0,0 +1,15 @@
+#pragma once
+// Char widths
+// these come from tables generated from the Unicode data (see unicode/gen_widths.py), rather than wcwidth(), since that's slow and depends on the locale
+// there's a table for each of several Unicode versions, so the widths can be made to match the programs running in the terminal (which might be on another machine)
+
+#include "common.h"
+
+// choose the table for a Unicode version (e.g. "15.0", or "15" for the newest 15.x), "" for the newest one, or "libc" to use wcwidth() instead
+// returns false if there's no table for that version. then the nearest older one is used (or the oldest one, if they're all newer), or the newest one if `version` isn't a version number
+bool set_unicode_version(const utf8* version);
+// the version of the current table (or "libc")
+const utf8* unicode_version(void);
+// width of a char: 0 (combining chars etc.), 1, or 2 (wide)
+// (control chars and unassigned chars are 1)
+int unicode_width(Char c);
@@ -0,0 +1,125 @@
+// Decoding utf-8
+
+#include <stdio.h>
+#ifdef __SSE2__
+ #include <emmintrin.h>
+#endif
+
+#include "common.h"
+#include "utf8.h"
+
+// 128, 192, 224, 240, 248
+static const int8_t UTF8_TYPE[32] = {
+	// 0 - ascii byte
+	[16] = 1,1,1,1,1,1,1,1, // 1 - continuation byte
+	[24] = 2,2,2,2, // 2 - start of 2 byte sequence
+	[28] = 3,3, // 3 - start of 3 byte sequence
+	[30] = 4, // 4 - start of 4 byte sequence
+	[31] = -1, // invalid
+};
+
+// process one byte
+// this handles all the error cases, and is what defines the decoder's behavior
+// (invalid bytes and unexpected continuation bytes are skipped, and an interrupted sequence becomes U+FFFD)
+static int decode_byte(Utf8Decoder* d, unsigned char b, Char out[2]) {
+	int type = UTF8_TYPE[b>>3]; // figure out what type of utf-8 byte this is (number of leading 1 bits) using a lookup table
+	Char c = b & (1<<7-type)-1; // extract the data bits
+	
+	if (type==1) { // continuation byte
+		if (d->remaining>0) {
+			d->remaining--;
+			d->buffer |= c<<(6*d->remaining);
+			if (d->remaining==0) {
+				out[0] = d->buffer;
+				return 1;
+			}
+		} else {
+			if (DEBUG.utf8)
+				print("Invalid utf8! unexpected continuation byte\n");
+		}
+		return 0;
+	}
+	if (type==-1) { // invalid
+		if (DEBUG.utf8)
+			print("Invalid utf8! invalid byte\n");
+		return 0;
+	}
+	// start byte
+	int n = 0;
+	if (d->remaining!=0) {
+		if (DEBUG.utf8)
+			print("Invalid utf8! interrupted sequence\n");
+		out[n++] = 0xFFFD;
+	}
+	if (type==0) {
+		d->remaining = 0;
+		out[n++] = c;
+	} else {
+		d->remaining = type-1;
+		d->buffer = c<<(6*d->remaining);
+	}
+	return n;
+}
+
+// decode `len` bytes into `out`, and return the number of chars written.
+// (there can be at most len+1 chars, if there was an interrupted sequence left over from the previous call)
+// the output is exactly the same as calling decode_byte on each byte,
+// but ascii and complete sequences are handled in bulk when the decoder isn't in the middle of a sequence
+int utf8_decode(Utf8Decoder* d, int len, const utf8 in[len], Char out[len+1]) {
+	int n = 0;
+	int i = 0;
+	while (i<len) {
+		if (d->remaining==0) {
+			unsigned char b = in[i];
+			if (b<0x80) {
+#ifdef __SSE2__
+				// widen 16 ascii bytes at a time
+				const __m128i zero = _mm_setzero_si128();
+				for (; i+16<=len; i+=16, n+=16) {
+					__m128i v = _mm_loadu_si128((const __m128i*)&in[i]);
+					if (_mm_movemask_epi8(v))
+						break;
+					__m128i lo = _mm_unpacklo_epi8(v, zero);
+					__m128i hi = _mm_unpackhi_epi8(v, zero);
+					_mm_storeu_si128((__m128i*)&out[n], _mm_unpacklo_epi16(lo, zero));
+					_mm_storeu_si128((__m128i*)&out[n+4], _mm_unpackhi_epi16(lo, zero));
+					_mm_storeu_si128((__m128i*)&out[n+8], _mm_unpacklo_epi16(hi, zero));
+					_mm_storeu_si128((__m128i*)&out[n+12], _mm_unpackhi_epi16(hi, zero));
+				}
+#endif
+				while (i<len && (unsigned char)in[i]<0x80)
+					out[n++] = in[i++];
+				continue;
+			}
+			// complete multi-byte sequence: check all the continuation bytes at once
+			int type = UTF8_TYPE[b>>3];
+			if (type>=2 && i+type<=len) {
+				// (a byte is a continuation byte if (byte^0x80) has the top 2 bits clear)
+				const unsigned char* s = (const unsigned char*)&in[i];
+				Char c;
+				bool ok;
+				switch (type) {
+				case 2:
+					ok = !((s[1]^0x80) & 0xC0);
+					c = (b & 0x1F)<<6 | (s[1] & 0x3F);
+					break;
+				case 3:
+					ok = !(((s[1]^0x80) | (s[2]^0x80)) & 0xC0);
+					c = (b & 0x0F)<<12 | (s[1] & 0x3F)<<6 | (s[2] & 0x3F);
+					break;
+				default:
+					ok = !(((s[1]^0x80) | (s[2]^0x80) | (s[3]^0x80)) & 0xC0);
+					c = (b & 0x07)<<18 | (s[1] & 0x3F)<<12 | (s[2] & 0x3F)<<6 | (s[3] & 0x3F);
+				}
+				if (ok) {
+					out[n++] = c;
+					i += type;
+					continue;
+				}
+			}
+		}
+		// anything else (errors, sequences split across calls) goes one byte at a time
+		n += decode_byte(d, in[i++], &out[n]);
+	}
+	return n;
+}
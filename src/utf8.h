@@ -0,0 +1,11 @@
+#pragma once
+
+#include "common.h"
+
+// state for decoding a stream of utf-8 which may be split into several pieces
+typedef struct Utf8Decoder {
+	Char buffer; // data bits of the sequence being decoded
+	int remaining; // number of continuation bytes still expected
+} Utf8Decoder;
+
+int utf8_decode(Utf8Decoder* d, int len, const utf8 in[len], Char out[len+1]);
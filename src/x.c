@@ -25,6 +25,9 @@
 #include "event.h"
 #include "settings.h"
 #include "icon.h"
+#include "host.h"
+#include "draw2.h"
+#include "clipboard.h"
 
 #include "xft/Xft.h"
 //#include "lua.h"
@@ -124,6 +127,9 @@ static Nanosec timediff(struct timespec t1, struct timespec t2) {
 
 static Nanosec min_redraw = 10*1000*1000;
 
+// while synchronized output (mode 2026) is on, redraws are held back, but only for this long
+static Nanosec max_sync_hold = 150*1000*1000;
+
 // todo: clean this up
 static void run(void) {
 	XMapWindow(W.d, W.win);
@@ -150,6 +156,8 @@ static void run(void) {
 	Fd xfd = XConnectionNumber(W.d);
 	
 	struct timespec last_redraw = {0};
+	bool holding = false; // whether a redraw is being held back due to synchronized output
+	struct timespec hold_start;
 	
 	while (1) {
 		if (tty_read()) {
@@ -164,6 +172,9 @@ static void run(void) {
 				(HANDLERS[ev.type])(&ev);
 		}
 		
+		// send any replies from the parser, and keypresses etc.
+		tty_flush();
+		
 		Nanosec timeout = (Nanosec)10000*1000*1000;
 		
 		if (redraw) {
@@ -171,9 +182,21 @@ static void run(void) {
 			clock_gettime(CLOCK_MONOTONIC, &now);
 			Nanosec since_last = timediff(now, last_redraw);
 			//print("since last: %lld", since_last/1000/1000);
-			if (since_last>=min_redraw) {
+			Nanosec held = 0;
+			if (T.synchronized) {
+				if (!holding) {
+					holding = true;
+					hold_start = now;
+				}
+				held = timediff(now, hold_start);
+			}
+			if (T.synchronized && held<max_sync_hold) {
+				// wait for the app to finish updating the screen
+				timeout = max_sync_hold - held + 1000;
+			} else if (since_last>=min_redraw) {
 				draw(false);
 				redraw = false;
+				holding = false;
 				last_redraw = now;
 			} else {
 				timeout = min_redraw - since_last + 1000;
@@ -241,6 +264,16 @@ int main(int argc, char* argv[argc+1]) {
 	
 	time_log(NULL);
 	
+	host = (Host){
+		.set_title = set_title,
+		.set_clipboard = own_clipboard,
+		.change_font = change_font,
+		.parse_color = parse_x_color,
+		.write = tty_write,
+		.dirty_all = dirty_all,
+		.rotate_rows = draw_rotate_rows,
+	};
+	
 	for (int i=0; i<argc; i++) {
 		print("%s\n", argv[i]);
 	}
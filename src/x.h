@@ -3,8 +3,10 @@
 #include <X11/Xlib.h>
 #include <X11/extensions/Xrender.h>
 #include <X11/Xatom.h>
+#include <fontconfig/fontconfig.h>
 
 #include "common.h"
+#include "buffer.h"
 
 // globals
 typedef struct Xw {
@@ -49,3 +51,9 @@ __attribute__((noreturn)) void sleep_forever(bool hangup);
 void clippaste(void);
 void change_size(int width, int height, bool charsize, bool do_resize);
 void force_redraw(void);
+void set_title(utf8* s);
+void change_font(const utf8* name);
+
+// (defined in settings.c)
+void pattern_default_substitute(FcPattern* pattern);
+bool parse_x_color(const utf8* c, RGBColor* out);
@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+# generate src/unicode_tables.h (the char width tables) from the Unicode data files
+# usage: gen_widths.py <ucd directory> > src/unicode_tables.h
+# (or `make unicode`, which uses unicode/ucd/)
+# the directory should have these files from https://www.unicode.org/Public/<version>/ucd/ (subdirectories are searched too):
+# - EastAsianWidth.txt
+# - DerivedAge.txt
+# - PropList.txt
+# - extracted/DerivedGeneralCategory.txt
+# - emoji/emoji-data.txt
+#
+# a table is made for each version in VERSIONS (up to the version of the data files):
+# each one only includes the chars which were assigned in that version, so that it matches what programs on a system with that version of the tables would do.
+# widths are taken from the newest data, except that emoji weren't wide before 9.0.
+# (the widths of a few other chars have changed over time, but these are rare)
+#
+# the rules are meant to match glibc's wcwidth():
+# - 0: combining chars (Mn, Me), format chars (Cf) except U+00AD soft hyphen and the prepended concatenation marks (which are visible), and hangul jungseong/jongseong (which join onto the previous jamo)
+# - 2: East Asian Width W or F, and U+3248-324F and U+4DC0-4DFF (which glibc also treats as wide, since they're in the middle of wide blocks)
+# - 1: everything else (including control chars and unassigned chars)
+
+import os
+import sys
+
+VERSIONS = ["8.0", "9.0", "10.0", "11.0", "12.1", "13.0", "14.0", "15.0", "15.1", "16.0"]
+
+BLOCK_BITS = 8 # (chars per block = 1<<BLOCK_BITS)
+CHARS = 0x110000
+
+def find_file(directory, name):
+	for root, dirs, files in os.walk(directory):
+		if name in files:
+			return os.path.join(root, name)
+	sys.exit(f"couldn't find {name} in {directory}")
+
+# yields (first, last, value) for each line like `0000..001F ; value # comment`
+def read_ranges(directory, name):
+	with open(find_file(directory, name), encoding="utf-8") as f:
+		for line in f:
+			line = line.split("#", 1)[0].strip()
+			if not line:
+				continue
+			chars, value = [x.strip() for x in line.split(";")[:2]]
+			first, _, last = chars.partition("..")
+			yield int(first, 16), int(last or first, 16), value
+
+def version_key(version):
+	return tuple(int(x) for x in version.split("."))
+
+def main(directory):
+	age = [None]*CHARS
+	for first, last, value in read_ranges(directory, "DerivedAge.txt"):
+		age[first:last+1] = [version_key(value)]*(last+1-first)
+	newest = max(a for a in age if a)
+	category = ["Cn"]*CHARS
+	for first, last, value in read_ranges(directory, "DerivedGeneralCategory.txt"):
+		category[first:last+1] = [value]*(last+1-first)
+	wide = [False]*CHARS
+	for first, last, value in read_ranges(directory, "EastAsianWidth.txt"):
+		if value in ("W", "F"):
+			wide[first:last+1] = [True]*(last+1-first)
+	for first, last in [(0x3248, 0x324F), (0x4DC0, 0x4DFF)]:
+		wide[first:last+1] = [True]*(last+1-first)
+	emoji = [False]*CHARS
+	for first, last, value in read_ranges(directory, "emoji-data.txt"):
+		if value == "Emoji_Presentation":
+			emoji[first:last+1] = [True]*(last+1-first)
+	visible = [False]*CHARS
+	for first, last, value in read_ranges(directory, "PropList.txt"):
+		if value == "Prepended_Concatenation_Mark":
+			visible[first:last+1] = [True]*(last+1-first)
+	visible[0xAD] = True
+
+	def width(c, version):
+		if not age[c] or age[c] > version:
+			return 1
+		if category[c] in ("Mn", "Me") or category[c]=="Cf" and not visible[c] or 0x1160<=c<=0x11FF or 0xD7B0<=c<=0xD7FF:
+			return 0
+		if wide[c]:
+			# (before 9.0, only the emoji in the enclosed ideographic supplement were wide)
+			if version < (9, 0) and emoji[c] and not 0x1F200<=c<=0x1F2FF:
+				return 1
+			return 2
+		return 1
+
+	versions = [v for v in VERSIONS if version_key(v) <= newest]
+	blocks = {} # packed block -> index
+	tables = []
+	for version in versions:
+		key = version_key(version)
+		table = []
+		for start in range(0, CHARS, 1<<BLOCK_BITS):
+			packed = bytearray((1<<BLOCK_BITS)//4)
+			for c in range(start, start+(1<<BLOCK_BITS)):
+				packed[(c-start)//4] |= width(c, key) << (c%4)*2
+			table.append(blocks.setdefault(bytes(packed), len(blocks)))
+		tables.append(table)
+	if len(blocks) > 256:
+		sys.exit("too many different blocks for a uint8_t index")
+
+	out = sys.stdout
+	out.write(f"// generated by unicode/gen_widths.py from the Unicode {'.'.join(map(str, newest))} data files. don't edit this\n")
+	out.write(f"// the width of char c is: width_blocks[table[c>>{BLOCK_BITS}]][(c&{(1<<BLOCK_BITS)-1})>>2] >> (c&3)*2 & 3\n\n")
+	out.write(f"#define WIDTH_BLOCK_BITS {BLOCK_BITS}\n\n")
+	out.write(f"static const uint8_t width_blocks[{len(blocks)}][{(1<<BLOCK_BITS)//4}] = {{\n")
+	for packed in blocks:
+		out.write("\t{" + ",".join(f"0x{b:02X}" for b in packed) + "},\n")
+	out.write("};\n\n")
+	out.write("// (oldest first)\n")
+	out.write(f"static const struct width_table {{\n\tconst char* version;\n\tuint8_t blocks[0x{CHARS:X}>>{BLOCK_BITS}];\n}} width_tables[{len(versions)}] = {{\n")
+	for version, table in zip(versions, tables):
+		out.write(f"\t{{\"{version}\", {{\n")
+		for i in range(0, len(table), 32):
+			out.write("\t\t" + ",".join(str(x) for x in table[i:i+32]) + ",\n")
+		out.write("\t}},\n")
+	out.write("};\n")
+
+if __name__ == "__main__":
+	if len(sys.argv) != 2:
+		sys.exit("usage: gen_widths.py <ucd directory>")
+	main(sys.argv[1])